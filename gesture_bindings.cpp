@@ -0,0 +1,143 @@
+#include "gesture_bindings.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+
+namespace {
+    struct ActionName {
+        const char* name;
+        GestureAction action;
+    };
+
+    const ActionName ACTION_NAMES[] = {
+        {"none",   GestureAction::NONE},
+        {"scroll", GestureAction::SCROLL},
+        {"page",   GestureAction::PAGE},
+        {"fling",  GestureAction::FLING},
+        {"edge",   GestureAction::EDGE},
+        {"zoom",   GestureAction::ZOOM},
+    };
+
+    std::string trim(const std::string& text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) return std::string();
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+}
+
+GestureBindings::GestureBindings() {
+    for (int type = 0; type < static_cast<int>(GestureType::COUNT); type++) {
+        for (int fingers = 0; fingers <= MAX_FINGERS; fingers++) {
+            table_[type][fingers] = GestureAction::NONE;
+        }
+    }
+    bind(GestureType::SWIPE, 3, GestureAction::SCROLL);
+    bind(GestureType::TOUCH, 3, GestureAction::SCROLL);
+    bind(GestureType::PINCH, 2, GestureAction::ZOOM);
+}
+
+void GestureBindings::bind(GestureType type, int fingers, GestureAction action) {
+    if (fingers < 1 || fingers > MAX_FINGERS) {
+        return;
+    }
+    table_[static_cast<int>(type)][fingers] = action;
+}
+
+bool GestureBindings::parseBinding(const std::string& spec) {
+    std::string text = trim(spec);
+    size_t colon = text.find(':');
+    size_t equals = text.find('=');
+    if (colon == std::string::npos || equals == std::string::npos || equals < colon) {
+        std::cerr << "Ошибка: назначение должно иметь вид тип:пальцы=действие: " << spec << std::endl;
+        return false;
+    }
+
+    std::string type_name = trim(text.substr(0, colon));
+    std::string fingers_text = trim(text.substr(colon + 1, equals - colon - 1));
+    std::string action_name = trim(text.substr(equals + 1));
+
+    GestureType type;
+    if (type_name == "swipe") {
+        type = GestureType::SWIPE;
+    } else if (type_name == "touch") {
+        type = GestureType::TOUCH;
+    } else if (type_name == "pinch") {
+        type = GestureType::PINCH;
+    } else {
+        std::cerr << "Ошибка: неизвестный тип жеста '" << type_name << "' (swipe, touch, pinch)" << std::endl;
+        return false;
+    }
+
+    char* end = nullptr;
+    long fingers = strtol(fingers_text.c_str(), &end, 10);
+    if (fingers_text.empty() || *end != '\0' || fingers < 1 || fingers > MAX_FINGERS) {
+        std::cerr << "Ошибка: число пальцев должно быть от 1 до " << MAX_FINGERS << ": " << spec << std::endl;
+        return false;
+    }
+
+    for (const ActionName& entry : ACTION_NAMES) {
+        if (action_name != entry.name) {
+            continue;
+        }
+        // Масштаб задается только расстоянием между пальцами, а pinch ничего не прокручивает
+        bool pinch = type == GestureType::PINCH;
+        if (entry.action != GestureAction::NONE && pinch != (entry.action == GestureAction::ZOOM)) {
+            std::cerr << "Ошибка: действие zoom доступно только для pinch, а pinch - только zoom или none: "
+                      << spec << std::endl;
+            return false;
+        }
+        bind(type, static_cast<int>(fingers), entry.action);
+        return true;
+    }
+
+    std::cerr << "Ошибка: неизвестное действие '" << action_name
+              << "' (none, scroll, page, fling, edge, zoom)" << std::endl;
+    return false;
+}
+
+bool GestureBindings::loadFile(const std::string& path) {
+    std::ifstream file(path.c_str());
+    if (!file) {
+        std::cerr << "Ошибка: не удалось открыть файл назначений " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        if (trim(line).empty()) {
+            continue;
+        }
+        if (!parseBinding(line)) {
+            std::cerr << "  (" << path << ":" << line_number << ")" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void GestureBindings::print(GestureType type) const {
+    const char* type_name = type == GestureType::SWIPE ? "swipe" :
+                            type == GestureType::TOUCH ? "touch" : "pinch";
+    for (int fingers = 1; fingers <= MAX_FINGERS; fingers++) {
+        GestureAction action = lookup(type, fingers);
+        if (action != GestureAction::NONE) {
+            std::cout << "  " << type_name << ":" << fingers << "=" << actionName(action) << std::endl;
+        }
+    }
+}
+
+const char* GestureBindings::actionName(GestureAction action) {
+    for (const ActionName& entry : ACTION_NAMES) {
+        if (entry.action == action) {
+            return entry.name;
+        }
+    }
+    return "none";
+}
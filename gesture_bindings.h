@@ -0,0 +1,80 @@
+#ifndef GESTURE_BINDINGS_H
+#define GESTURE_BINDINGS_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Источник жеста
+ */
+enum class GestureType : uint8_t {
+    SWIPE = 0,  // Swipe на тачпаде (gesture-scroll)
+    TOUCH = 1,  // Касание сенсорного экрана (touch-scroll)
+    PINCH = 2,  // Pinch на тачпаде (gesture-scroll)
+    COUNT
+};
+
+/**
+ * Действие, назначенное жесту
+ */
+enum class GestureAction : uint8_t {
+    NONE = 0,   // Жест игнорируется
+    SCROLL,     // Непрерывная плавная прокрутка (и инерция после отрыва пальцев)
+    PAGE,       // Один Page Up / Page Down по направлению жеста
+    FLING,      // Только инерция со скоростью жеста в момент отрыва пальцев
+    EDGE,       // В начало / в конец документа по направлению жеста
+    ZOOM        // Масштаб Ctrl + колесико по изменению расстояния между пальцами (только pinch)
+};
+
+/**
+ * Таблица назначений: (тип жеста, число пальцев) -> действие.
+ *
+ * Обработчики ищут действие одним обращением к массиву при начале жеста.
+ * Назначения задаются строками вида "touch:2=scroll" - в командной строке
+ * (--bind) или в файле по одному на строку (--bindings), '#' - комментарий.
+ * По умолчанию 3 пальца на тачпаде и на экране прокручивают, pinch двумя
+ * пальцами масштабирует.
+ */
+class GestureBindings {
+public:
+    static const int MAX_FINGERS = 10;
+
+    GestureBindings();
+
+    /**
+     * Действие для жеста; NONE для числа пальцев вне таблицы
+     */
+    GestureAction lookup(GestureType type, int fingers) const {
+        if (fingers < 0 || fingers > MAX_FINGERS) {
+            return GestureAction::NONE;
+        }
+        return table_[static_cast<int>(type)][fingers];
+    }
+
+    /**
+     * Назначить действие
+     */
+    void bind(GestureType type, int fingers, GestureAction action);
+
+    /**
+     * Разбор одного назначения "тип:пальцы=действие"
+     */
+    bool parseBinding(const std::string& spec);
+
+    /**
+     * Загрузка назначений из файла (дополняют и переопределяют текущие)
+     */
+    bool loadFile(const std::string& path);
+
+    /**
+     * Вывод назначений для подробного режима
+     */
+    void print(GestureType type) const;
+
+    static const char* actionName(GestureAction action);
+
+private:
+    GestureAction table_[static_cast<int>(GestureType::COUNT)][MAX_FINGERS + 1];
+};
+
+#endif // GESTURE_BINDINGS_H
@@ -1,19 +1,10 @@
 #include "gesture_scroll_handler.h"
 #include <iostream>
-#include <csignal>
 #include <getopt.h>
 #include <cstdlib>
 #include <unistd.h>
-
-// Глобальная переменная для обработчика жестов
-GestureScrollHandler* g_handler = nullptr;
-
-void signalHandler(int signal) {
-    if (g_handler) {
-        std::cout << "\nПолучен сигнал " << signal << ", завершаем работу..." << std::endl;
-        g_handler->stop();
-    }
-}
+#include <string>
+#include <vector>
 
 void printUsage(const char* program_name) {
     std::cout << "Использование: " << program_name << " [OPTIONS]\n\n";
@@ -22,16 +13,32 @@ void printUsage(const char* program_name) {
     std::cout << "  Демон для обработки 3-пальцевых swipe жестов с плавной прокруткой\n";
     std::cout << "  Основан на интеграции touchegg (libinput) + touch-control (scroll emulator)\n\n";
     
-    std::cout << "ЖЕСТЫ:\n";
+    std::cout << "ЖЕСТЫ (по умолчанию, см. --bind):\n";
     std::cout << "  3 пальца вверх      Плавная прокрутка вверх\n";
     std::cout << "  3 пальца вниз       Плавная прокрутка вниз\n";
     std::cout << "  3 пальца влево      Плавная прокрутка влево (горизонтальная)\n";
-    std::cout << "  3 пальца вправо     Плавная прокрутка вправо (горизонтальная)\n\n";
+    std::cout << "  3 пальца вправо     Плавная прокрутка вправо (горизонтальная)\n";
+    std::cout << "  Pinch 2 пальцами    Масштаб (Ctrl + колесико)\n";
+    std::cout << "  Пальцы без движения Остановить плавную и инерционную прокрутку (libinput 1.19+)\n\n";
     
     std::cout << "ОПЦИИ:\n";
     std::cout << "  -d, --delay DELAY        Задержка между шагами скролла в мс (по умолчанию 50)\n";
-    std::cout << "  -s, --smooth STEPS       Количество промежуточных шагов для плавности (по умолчанию 1)\n";
+    std::cout << "  -s, --smooth STEPS       Устарело, не влияет: hi-res вывод всегда дробный\n";
     std::cout << "  -a, --accel FACTOR       Ускорение для плавного скролла (1.0 = постоянная скорость)\n";
+    std::cout << "      --no-inertia         Не продолжать прокрутку по инерции после отрыва пальцев\n";
+    std::cout << "  -b, --bind SPEC          Назначить действие жесту: swipe|pinch|touch:ПАЛЬЦЫ=ДЕЙСТВИЕ (можно повторять)\n";
+    std::cout << "                           Действия: scroll, page, fling, edge, none; для pinch - zoom, none\n";
+    std::cout << "  -B, --bindings FILE      Загрузить назначения из файла (по одному на строку, # - комментарий)\n";
+    std::cout << "      --touchscreen        Обрабатывать также сенсорный экран (touch:N в --bind) в этом же процессе\n";
+    std::cout << "  -c, --control PATH       Управляющий unix сокет: команды stop, cancel, status\n";
+    std::cout << "      --device DEVICE      Использовать только это устройство: имя libinput, eventN или vid:pid\n";
+    std::cout << "                           (можно повторять; остальные устройства libinput не открывает)\n";
+    std::cout << "      --path FILE          Открыть только устройство /dev/input/eventN без udev и seat (можно повторять)\n";
+    std::cout << "      --seat NAME          Seat для поиска устройств через udev (по умолчанию seat0)\n";
+    std::cout << "      --input-thread       Читать устройства в отдельном потоке ввода\n";
+    std::cout << "      --rt-priority N      Приоритет реального времени потока ввода (1-99, нужна CAP_SYS_NICE)\n";
+    std::cout << "      --rt-policy POLICY   Политика планировщика потока ввода: fifo (по умолчанию) или rr\n";
+    std::cout << "      --cpu N              Привязать поток ввода к CPU N\n";
     std::cout << "  -v, --verbose            Подробный вывод (показывать обнаруженные жесты)\n";
     std::cout << "  -q, --quiet              Тихий режим (минимальный вывод)\n";
     std::cout << "  -h, --help               Показать эту справку\n";
@@ -41,8 +48,14 @@ void printUsage(const char* program_name) {
     std::cout << "ПРИМЕРЫ:\n";
     std::cout << "  " << program_name << "                              # Запуск с настройками по умолчанию\n";
     std::cout << "  " << program_name << " -v                           # Запуск с подробным выводом\n";
-    std::cout << "  " << program_name << " -d 30 -s 3                   # Быстрый и плавный скролл\n";
+    std::cout << "  " << program_name << " -d 30                        # Быстрый и плавный скролл\n";
     std::cout << "  " << program_name << " -a 1.5 --verbose             # С ускорением и отладкой\n";
+    std::cout << "  " << program_name << " -b swipe:4=page              # 4 пальца - постраничная прокрутка\n";
+    std::cout << "  " << program_name << " --touchscreen                # Тачпад и сенсорный экран вместе\n";
+    std::cout << "  " << program_name << " --rt-priority 50 --cpu 2     # Поток ввода SCHED_FIFO на CPU 2\n";
+    std::cout << "  " << program_name << " --touchscreen --device 04f3:2234  # Только один сенсорный экран\n";
+    std::cout << "  " << program_name << " --touchscreen --path /dev/input/event5  # Киоск в контейнере без udev\n";
+    std::cout << "  " << program_name << " -c /tmp/gesture-scroll.ctl   # Управление: echo stop | socat - UNIX-CONNECT:/tmp/gesture-scroll.ctl\n";
     std::cout << "  " << program_name << " --test                       # Проверить совместимость системы\n";
     std::cout << "  " << program_name << " --daemon -q                  # Запуск в фоне\n\n";
     
@@ -122,10 +135,18 @@ void printSystemInfo() {
 
 int main(int argc, char* argv[]) {
     ScrollEmulator::ScrollConfig config;
+    config.shared_memory_transport = true; // Скролл почти на каждое событие - без send() на каждое
     bool verbose = false;
     bool quiet = false;
     bool test_mode = false;
     bool daemon_mode = false;
+    bool touchscreen = false;
+    std::string control_path;
+    ScrollEngine::InputThreadConfig input_thread;
+    std::vector<ScrollEngine::DeviceFilter> device_filters;
+    std::vector<std::string> device_paths;
+    std::string seat;
+    GestureBindings bindings;
     
     // Парсим опции командной строки
     static struct option long_options[] = {
@@ -137,13 +158,25 @@ int main(int argc, char* argv[]) {
         {"help",     no_argument,       0, 'h'},
         {"test",     no_argument,       0, 't'},
         {"daemon",   no_argument,       0, 'D'},
+        {"no-inertia", no_argument,     0, 'I'},
+        {"bind",     required_argument, 0, 'b'},
+        {"bindings", required_argument, 0, 'B'},
+        {"touchscreen", no_argument,    0, 'T'},
+        {"control",  required_argument, 0, 'c'},
+        {"input-thread", no_argument,   0, 'X'},
+        {"rt-priority", required_argument, 0, 'P'},
+        {"rt-policy", required_argument, 0, 'R'},
+        {"cpu",      required_argument, 0, 'U'},
+        {"device",   required_argument, 0, 'E'},
+        {"path",     required_argument, 0, 'F'},
+        {"seat",     required_argument, 0, 'S'},
         {0, 0, 0, 0}
     };
     
     int option_index = 0;
     int c;
     
-    while ((c = getopt_long(argc, argv, "d:s:a:vqhtD", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "d:s:a:vqhtDb:B:c:", long_options, &option_index)) != -1) {
         switch (c) {
             case 'd':
                 config.delay_ms = atoi(optarg);
@@ -184,6 +217,68 @@ int main(int argc, char* argv[]) {
             case 'D':
                 daemon_mode = true;
                 break;
+            case 'I':
+                config.kinetic_scrolling = false;
+                break;
+            case 'b':
+                if (!bindings.parseBinding(optarg)) {
+                    return 1;
+                }
+                break;
+            case 'B':
+                if (!bindings.loadFile(optarg)) {
+                    return 1;
+                }
+                break;
+            case 'T':
+                touchscreen = true;
+                break;
+            case 'c':
+                control_path = optarg;
+                break;
+            case 'X':
+                input_thread.enabled = true;
+                break;
+            case 'P':
+                input_thread.priority = atoi(optarg);
+                if (input_thread.priority < 1 || input_thread.priority > 99) {
+                    std::cerr << "Ошибка: приоритет реального времени должен быть от 1 до 99" << std::endl;
+                    return 1;
+                }
+                input_thread.enabled = true;
+                break;
+            case 'R':
+                if (std::string(optarg) == "fifo") {
+                    input_thread.policy = SCHED_FIFO;
+                } else if (std::string(optarg) == "rr") {
+                    input_thread.policy = SCHED_RR;
+                } else {
+                    std::cerr << "Ошибка: политика планировщика должна быть fifo или rr" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'U':
+                input_thread.cpu = atoi(optarg);
+                if (input_thread.cpu < 0 || input_thread.cpu >= CPU_SETSIZE) {
+                    std::cerr << "Ошибка: неверный номер CPU: " << optarg << std::endl;
+                    return 1;
+                }
+                input_thread.enabled = true;
+                break;
+            case 'E': {
+                ScrollEngine::DeviceFilter filter;
+                if (!ScrollEngine::DeviceFilter::parse(optarg, filter)) {
+                    return 1;
+                }
+                device_filters.push_back(filter);
+                break;
+            }
+            case 'F':
+                device_paths.push_back(optarg);
+                break;
+            case 'S':
+                seat = optarg;
+                break;
             case '?':
                 return 1;
             default:
@@ -232,19 +327,36 @@ int main(int argc, char* argv[]) {
         std::cout << "=== Gesture Scroll Daemon ===" << std::endl;
         std::cout << "Интеграция touchegg + touch-control для плавной прокрутки" << std::endl;
         std::cout << "Настройки: задержка=" << config.delay_ms << "мс, шаги=" << config.smooth_steps;
-        std::cout << ", ускорение=" << config.acceleration << std::endl << std::endl;
+        std::cout << ", ускорение=" << config.acceleration << std::endl;
+        if (verbose) {
+            std::cout << "Назначения жестов:" << std::endl;
+            bindings.print(GestureType::SWIPE);
+            bindings.print(GestureType::PINCH);
+            if (touchscreen) {
+                bindings.print(GestureType::TOUCH);
+            }
+        }
+        std::cout << std::endl;
     }
     
     // Создаем и инициализируем обработчик жестов
+    // SIGINT/SIGTERM/SIGHUP обрабатывает цикл событий через signalfd
     GestureScrollHandler handler;
-    g_handler = &handler;
-    
-    // Настраиваем обработку сигналов
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
     
     handler.setVerbose(verbose);
     handler.setScrollConfig(config);
+    handler.setBindings(bindings);
+    handler.setTouchscreen(touchscreen);
+    handler.setControlSocket(control_path);
+    handler.setInputThread(input_thread);
+    handler.setDeviceFilters(device_filters);
+    handler.setDevicePaths(device_paths);
+    if (!seat.empty()) {
+        if (!device_paths.empty()) {
+            std::cerr << "Предупреждение: --seat не действует вместе с --path" << std::endl;
+        }
+        handler.setSeat(seat);
+    }
     
     if (!handler.initialize()) {
         if (!quiet) {
@@ -1,55 +1,97 @@
 #ifndef GESTURE_SCROLL_HANDLER_H
 #define GESTURE_SCROLL_HANDLER_H
 
-#include <libinput.h>
-#include <libudev.h>
-#include <memory>
-#include <chrono>
-#include "scroll_emulator.h"
+#include "scroll_engine.h"
 
 /**
- * Состояние жеста для отслеживания swipe с 3 пальцами
+ * Состояние жеста для отслеживания swipe и pinch на тачпаде
  */
-struct GestureScrollState {
-    bool active = false;
-    double total_delta_x = 0.0;
-    double total_delta_y = 0.0;
+struct GestureScrollState : MotionState {
     double last_delta_x = 0.0;
     double last_delta_y = 0.0;
     int finger_count = 0;
-    std::chrono::steady_clock::time_point last_scroll_time;
-    std::chrono::steady_clock::time_point gesture_start_time;
     
-    // Пороги для определения направления и начала скролла
-    static constexpr double START_THRESHOLD = 10.0;  // Минимальное движение для начала
-    static constexpr double SCROLL_THRESHOLD = 2.0;  // Минимальное движение для продолжения скролла
-    static constexpr int MIN_SCROLL_INTERVAL_MS = 16; // Минимальный интервал между скроллами (60 FPS)
+    // Pinch: масштаб libinput на прошлом обновлении и еще не выведенный зум
+    double last_scale = 1.0;
+    ScrollAccumulator zoom;
+    
+    static constexpr double ZOOM_DETENTS_PER_DOUBLING = 4.0; // Ступеней Ctrl+колесика на удвоение расстояния между пальцами
     
     void reset() {
-        active = false;
-        total_delta_x = 0.0;
-        total_delta_y = 0.0;
+        resetMotion();
         last_delta_x = 0.0;
         last_delta_y = 0.0;
         finger_count = 0;
+        last_scale = 1.0;
+        zoom.reset();
     }
 };
 
 /**
- * Направления жестов
+ * Направления жестов (прежнее имя GestureDirection)
  */
-enum class SwipeDirection {
-    UNKNOWN = 0,
-    UP = 1,
-    DOWN = 2,
-    LEFT = 3,
-    RIGHT = 4
-};
+typedef GestureDirection SwipeDirection;
 
 /**
- * Обработчик жестов для плавной прокрутки
+ * Источник жестов тачпада: swipe (прокрутка), pinch (масштаб) и hold (остановка)
  * Основан на libinput swipe handler из touchegg, но адаптирован для непрерывной прокрутки
  */
+class SwipeGestureSource : public GestureSource {
+public:
+    explicit SwipeGestureSource(ScrollEngine& engine);
+    
+    bool handleEvent(const InputEvent& event) override;
+    enum libinput_device_capability capability() const override { return LIBINPUT_DEVICE_CAP_GESTURE; }
+    
+    /**
+     * Параметры движения тачпада
+     */
+    static const MotionProfile PROFILE;
+
+private:
+    ScrollEngine& engine_;
+    GestureScrollState gesture_state_;
+    
+    /**
+     * Обработка начала swipe жеста
+     */
+    void handleSwipeBegin(const InputEvent& event);
+    
+    /**
+     * Обработка обновления swipe жеста
+     */
+    void handleSwipeUpdate(const InputEvent& event);
+    
+    /**
+     * Обработка завершения swipe жеста
+     */
+    void handleSwipeEnd(const InputEvent& event);
+    
+    /**
+     * Обработка начала pinch жеста
+     */
+    void handlePinchBegin(const InputEvent& event);
+    
+    /**
+     * Обработка обновления pinch жеста: изменение масштаба -> Ctrl + колесико
+     */
+    void handlePinchUpdate(const InputEvent& event);
+    
+    /**
+     * Обработка завершения pinch жеста
+     */
+    void handlePinchEnd(const InputEvent& event);
+    
+    /**
+     * Пальцы легли на тачпад без движения (hold): остановить плавный и инерционный скролл
+     */
+    void handleHoldBegin(const InputEvent& event);
+};
+
+/**
+ * Обработчик жестов тачпада для плавной прокрутки: ScrollEngine с источником
+ * SwipeGestureSource и, по желанию, источником сенсорного экрана в том же процессе
+ */
 class GestureScrollHandler {
 public:
     GestureScrollHandler();
@@ -83,67 +125,47 @@ public:
     /**
      * Включить/отключить подробный вывод
      */
-    void setVerbose(bool verbose) { verbose_ = verbose; }
-
-private:
-    struct libinput* li_;
-    struct udev* udev_;
-    int fd_;
-    bool running_;
-    bool verbose_;
-    
-    std::unique_ptr<ScrollEmulator> scroll_emulator_;
-    GestureScrollState gesture_state_;
+    void setVerbose(bool verbose) { verbose_ = verbose; engine_.setVerbose(verbose); }
     
     /**
-     * Обработка событий libinput
+     * Назначения жестов (число пальцев -> действие)
      */
-    void processEvents();
+    void setBindings(const GestureBindings& bindings) { engine_.setBindings(bindings); }
     
     /**
-     * Обработка начала swipe жеста
+     * Управляющий unix сокет (команды stop, cancel, status)
      */
-    void handleSwipeBegin(struct libinput_event_gesture* gesture);
+    void setControlSocket(const std::string& path) { engine_.setControlSocket(path); }
     
     /**
-     * Обработка обновления swipe жеста
-     */
-    void handleSwipeUpdate(struct libinput_event_gesture* gesture);
-    
-    /**
-     * Обработка завершения swipe жеста
-     */
-    void handleSwipeEnd(struct libinput_event_gesture* gesture);
-    
-    /**
-     * Определение направления жеста
-     */
-    SwipeDirection calculateDirection(double delta_x, double delta_y);
-    
-    /**
-     * Выполнение плавной прокрутки на основе дельты движения
+     * Отдельный поток ввода (приоритет реального времени, привязка к CPU)
      */
-    void performSmoothScroll(double delta_x, double delta_y);
+    void setInputThread(const ScrollEngine::InputThreadConfig& config) { engine_.setInputThread(config); }
     
     /**
-     * Проверка, прошло ли достаточно времени для следующего скролла
+     * Разрешенные устройства (имя, eventN или vid:pid)
      */
-    bool shouldScroll();
+    void setDeviceFilters(const std::vector<ScrollEngine::DeviceFilter>& filters) { engine_.setDeviceFilters(filters); }
     
     /**
-     * Вычисление интенсивности скролла на основе скорости жеста
+     * Seat для udev (по умолчанию seat0)
      */
-    int calculateScrollIntensity(double delta, double time_diff_ms);
+    void setSeat(const std::string& seat) { engine_.setSeat(seat); }
     
     /**
-     * Открытие libinput устройства
+     * Явные пути /dev/input/eventN вместо перечисления устройств через udev
      */
-    static int openRestricted(const char* path, int flags, void* user_data);
+    void setDevicePaths(const std::vector<std::string>& paths) { engine_.setDevicePaths(paths); }
     
     /**
-     * Закрытие libinput устройства
+     * Обрабатывать также сенсорный экран из того же контекста libinput
      */
-    static void closeRestricted(int fd, void* user_data);
+    void setTouchscreen(bool enabled) { touchscreen_ = enabled; }
+
+private:
+    ScrollEngine engine_;
+    bool verbose_;
+    bool touchscreen_;
 };
 
-#endif // GESTURE_SCROLL_HANDLER_H 
\ No newline at end of file
+#endif // GESTURE_SCROLL_HANDLER_H 
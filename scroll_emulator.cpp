@@ -1,9 +1,11 @@
 #include "scroll_emulator.h"
+#include "scroll_protocol.h"
 #include <iostream>
 #include <unistd.h>
 #include <cstdlib>
 #include <sys/wait.h>
 #include <cstring>
+#include <cerrno>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
@@ -11,8 +13,331 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <ctime>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/file.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#ifdef HAVE_XTEST
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+#endif
+
+namespace {
+    // Одна ступень колесика в единицах REL_*_HI_RES
+    const int HIRES_PER_DETENT = 120;
+
+    uint64_t monotonicNanos() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+
+    uint64_t monotonicMicros() {
+        return monotonicNanos() / 1000ULL;
+    }
+
+    struct timespec toTimespec(uint64_t ns) {
+        struct timespec ts;
+        ts.tv_sec = ns / 1000000000ULL;
+        ts.tv_nsec = ns % 1000000000ULL;
+        return ts;
+    }
+
+    // Дельта записи от клиента: INT32_MIN отбрасывается (у него нет модуля),
+    // остальное ограничено SCROLL_MAX_DETENTS_PER_RECORD ступенями, чтобы
+    // одна запись не занимала общий daemon на миллионы кадров
+    bool recordDelta(const ScrollRecord& record, int& delta) {
+        if (record.delta == INT32_MIN) return false;
+        const int limit = (int)SCROLL_MAX_DETENTS_PER_RECORD * HIRES_PER_DETENT;
+        delta = std::max(-limit, std::min(limit, (int)record.delta));
+        return true;
+    }
+
+    ScrollRecord makeRecord(uint8_t type, uint8_t axis, int32_t delta, uint16_t flags) {
+        ScrollRecord record;
+        memset(&record, 0, sizeof(record));
+        record.type = type;
+        record.axis = axis;
+        record.flags = flags;
+        record.delta = delta;
+        record.timestamp_us = monotonicMicros();
+        return record;
+    }
+
+    // Потоковый разбор кадров протокола: байты копятся между recv(),
+    // из буфера извлекаются все полные кадры
+    class FrameParser {
+    public:
+        FrameParser() : failed_(false) {}
+
+        void feed(const char* data, size_t length) {
+            buffer_.insert(buffer_.end(), data, data + length);
+        }
+
+        // Возвращает false при нарушении протокола (соединение нужно закрыть)
+        bool parse(std::vector<ScrollRecord>& records) {
+            size_t offset = 0;
+
+            while (!failed_ && buffer_.size() - offset >= sizeof(ScrollFrameHeader)) {
+                ScrollFrameHeader header;
+                memcpy(&header, buffer_.data() + offset, sizeof(header));
+
+                if (header.magic != SCROLL_PROTOCOL_MAGIC ||
+                    header.version != SCROLL_PROTOCOL_VERSION ||
+                    header.record_count > SCROLL_PROTOCOL_MAX_RECORDS) {
+                    failed_ = true;
+                    break;
+                }
+
+                size_t frame_size = sizeof(header) + header.record_count * sizeof(ScrollRecord);
+                if (buffer_.size() - offset < frame_size) break; // Ждем остаток кадра
+
+                const char* data = buffer_.data() + offset + sizeof(header);
+                for (uint16_t i = 0; i < header.record_count; i++) {
+                    ScrollRecord record;
+                    memcpy(&record, data + i * sizeof(ScrollRecord), sizeof(record));
+                    records.push_back(record);
+                }
+                offset += frame_size;
+            }
+
+            buffer_.erase(buffer_.begin(), buffer_.begin() + offset);
+            return !failed_;
+        }
+
+    private:
+        std::vector<char> buffer_;
+        bool failed_;
+    };
+
+    // Состояние клиента uinput daemon'а
+    struct DaemonClient {
+        FrameParser parser;
+        std::vector<int> pending_fds;       // Дескрипторы из SCM_RIGHTS до записи SHM_ATTACH
+        ScrollRingHeader* ring = nullptr;   // Кольцо в общей памяти, если клиент его передал
+        size_t ring_size = 0;
+        uint32_t ring_capacity = 0;         // Проверенная при подключении; capacity в памяти клиента не читаем
+        int event_fd = -1;
+    };
+
+    // recv() с приемом дескрипторов, переданных через SCM_RIGHTS
+    ssize_t recvWithFds(int fd, char* buffer, size_t length, std::vector<int>& fds) {
+        struct iovec iov;
+        iov.iov_base = buffer;
+        iov.iov_len = length;
+
+        char control[CMSG_SPACE(sizeof(int) * 4)];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t bytes = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (bytes <= 0) return bytes;
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* received = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            for (size_t i = 0; i < n; i++) {
+                fds.push_back(received[i]);
+            }
+        }
+        return bytes;
+    }
+
+    // Отображает кольцо клиента: pending_fds = {memfd, eventfd}
+    bool attachRing(DaemonClient& client, uint32_t capacity) {
+        bool ok = client.ring == nullptr && client.pending_fds.size() == 2 &&
+                  capacity > 0 && capacity <= SCROLL_RING_MAX_CAPACITY &&
+                  (capacity & (capacity - 1)) == 0;
+
+        int mem_fd = client.pending_fds.empty() ? -1 : client.pending_fds[0];
+        size_t size = scrollRingSize(capacity);
+        void* memory = MAP_FAILED;
+
+        // Размер memfd должен быть запечатан: иначе клиент может укоротить его
+        // после mmap(), и чтение кольца уронит daemon по SIGBUS
+        if (ok) {
+            int seals = fcntl(mem_fd, F_GET_SEALS);
+            ok = seals >= 0 && (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) == (F_SEAL_SHRINK | F_SEAL_GROW);
+        }
+        if (ok) {
+            struct stat st;
+            ok = fstat(mem_fd, &st) == 0 && (size_t)st.st_size >= size;
+        }
+        if (ok) {
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+            ok = memory != MAP_FAILED;
+        }
+
+        if (ok) {
+            client.ring = static_cast<ScrollRingHeader*>(memory);
+            client.ring_size = size;
+            client.ring_capacity = capacity;
+            client.event_fd = client.pending_fds[1];
+            close(mem_fd); // Отображение остается действительным
+        } else {
+            for (size_t i = 0; i < client.pending_fds.size(); i++) {
+                close(client.pending_fds[i]);
+            }
+        }
+        client.pending_fds.clear();
+        return ok;
+    }
+
+    void detachRing(DaemonClient& client) {
+        if (client.ring) {
+            munmap(client.ring, client.ring_size);
+            client.ring = nullptr;
+            client.ring_capacity = 0;
+        }
+        if (client.event_fd >= 0) {
+            close(client.event_fd);
+            client.event_fd = -1;
+        }
+        for (size_t i = 0; i < client.pending_fds.size(); i++) {
+            close(client.pending_fds[i]);
+        }
+        client.pending_fds.clear();
+    }
+
+    // Забирает все записи из кольца. Перед уходом в ожидание выставляет
+    // consumer_waiting и перепроверяет кольцо, чтобы не потерять запись,
+    // положенную клиентом в этот момент. Память кольца клиент может менять
+    // в любой момент, поэтому емкость берется из проверенной при подключении
+    void drainRing(ScrollRingHeader* ring, uint32_t capacity, std::vector<ScrollRecord>& records) {
+        const ScrollRecord* slots = scrollRingRecords(ring);
+        uint32_t mask = capacity - 1;
+        uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+
+        while (true) {
+            ring->consumer_waiting.store(0, std::memory_order_relaxed);
+
+            uint32_t head = ring->head.load(std::memory_order_acquire);
+            if (head - tail > capacity) {
+                tail = head; // Поврежденные индексы - пропускаем содержимое
+            }
+            while (tail != head) {
+                records.push_back(slots[tail & mask]);
+                tail++;
+            }
+            ring->tail.store(tail, std::memory_order_release);
+
+            ring->consumer_waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ring->head.load(std::memory_order_acquire) == tail) break;
+        }
+    }
+
+    struct input_event {
+        unsigned long tv_sec;
+        unsigned long tv_usec;
+        unsigned short type;
+        unsigned short code;
+        int value;
+    };
+
+    // Буфер событий uinput: кадр (или несколько кадров) собирается в заранее
+    // выделенном массиве и уходит в устройство одним write()
+    class EventBatch {
+    public:
+        static const size_t CAPACITY = 96;
+
+        // write_failed - состояние ошибок записи в это устройство, общее для
+        // всех пачек его владельца
+        EventBatch(int fd, bool& write_failed) : fd_(fd), count_(0), failed_(write_failed) {
+            memset(events_, 0, sizeof(events_));
+        }
 
-ScrollEmulator::ScrollEmulator() : active_method(METHOD_NONE), socket_fd(-1), daemon_pid(-1) {
+        void add(unsigned short type, unsigned short code, int value) {
+            if (count_ == CAPACITY) flush();
+            events_[count_].type = type;
+            events_[count_].code = code;
+            events_[count_].value = value;
+            count_++;
+        }
+
+        void sync() {
+            add(0, 0, 0); // EV_SYN, SYN_REPORT
+        }
+
+        // false - кадр не дошел до устройства целиком
+        bool flush() {
+            if (count_ == 0) return true;
+
+            // uinput принимает несколько событий за одну запись; короткую
+            // запись дописываем, иначе кадр останется без SYN_REPORT
+            const char* data = reinterpret_cast<const char*>(events_);
+            size_t length = count_ * sizeof(input_event);
+            size_t written = 0;
+            count_ = 0;
+
+            while (written < length) {
+                ssize_t n = write(fd_, data + written, length - written);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    // Сообщаем один раз на серию ошибок, а не на каждый кадр
+                    if (!failed_) {
+                        std::cerr << "Ошибка записи в uinput: "
+                                  << (n < 0 ? strerror(errno) : "устройство не приняло данные") << std::endl;
+                    }
+                    failed_ = true;
+                    return false;
+                }
+                written += n;
+            }
+            failed_ = false;
+            return true;
+        }
+
+    private:
+        int fd_;
+        size_t count_;
+        input_event events_[CAPACITY];
+        bool& failed_;
+    };
+
+    // Добавляет в буфер кадр колесика: hi-res событие и, если набралась
+    // целая ступень, классическое событие для старых клиентов
+    void appendWheel(EventBatch& batch, bool vertical, int hires_value, int& remainder) {
+        // libinput использует hi-res ось вместо REL_WHEEL, если она объявлена
+        batch.add(2, vertical ? 11 : 12, hires_value); // EV_REL, REL_WHEEL_HI_RES / REL_HWHEEL_HI_RES
+
+        remainder += hires_value;
+        int detents = remainder / HIRES_PER_DETENT;
+        if (detents != 0) {
+            remainder -= detents * HIRES_PER_DETENT;
+            batch.add(2, vertical ? 8 : 6, detents); // EV_REL, REL_WHEEL / REL_HWHEEL
+        }
+
+        batch.sync();
+    }
+}
+
+ScrollEmulator::ScrollEmulator()
+    : active_method(METHOD_NONE), socket_fd(-1), uinput_fd(-1), x11_display(nullptr),
+      frame_timer_fd(-1), frame_period_ns(0), frame_deadline_ns(0),
+      shared_ring(nullptr), ring_event_fd(-1), config_changed(false), uinput_write_failed(false),
+      wheel_remainder_v(0), wheel_remainder_h(0),
+      precise_remainder_v(0), precise_remainder_h(0), zoom_remainder(0),
+      output_running(false), output_busy(false), dropped_intents(0), cancel_generation(0) {
+    memset(&animation_v, 0, sizeof(animation_v));
+    memset(&animation_h, 0, sizeof(animation_h));
     // Создаем уникальный путь для сокета
     uid_t uid = getuid();
     socket_path = "/tmp/scroll_emulator_" + std::to_string(uid) + ".sock";
@@ -22,6 +347,23 @@ ScrollEmulator::~ScrollEmulator() {
     cleanup();
 }
 
+void ScrollEmulator::setConfig(const ScrollConfig& cfg) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    requested_config = cfg;
+    if (output_thread.joinable()) {
+        // Поток вывода читает config без блокировки: новые настройки он
+        // заберет сам вместе со следующей пачкой намерений
+        config_changed = true;
+    } else {
+        config = cfg;
+    }
+}
+
+ScrollEmulator::ScrollConfig ScrollEmulator::getConfig() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return requested_config;
+}
+
 bool ScrollEmulator::initialize() {
     if (config.verbose) {
         std::cout << "=== Инициализация ScrollEmulator ===" << std::endl;
@@ -33,161 +375,488 @@ bool ScrollEmulator::initialize() {
         if (config.verbose) {
             std::cout << "✓ Используем X11 XTEST (как xdotool)" << std::endl;
         }
-        return true;
     }
-
-    // Метод 2: Daemon с uinput (как ydotool)
-    if (tryUinputDaemon()) {
+    // Метод 2: Прямой uinput (root или ACL на /dev/uinput). Daemon запускается
+    // с теми же правами, поэтому нужен только если устройство не открыть самим
+    else if (tryDirectUinput()) {
+        active_method = METHOD_DIRECT_UINPUT;
+        if (config.verbose) {
+            std::cout << "✓ Используем прямой uinput" << std::endl;
+        }
+    }
+    // Метод 3: Daemon с uinput (как ydotool): общий для клиентов, у которых
+    // нет своего доступа к /dev/uinput (уже запущенный daemon)
+    else if (tryUinputDaemon()) {
         active_method = METHOD_UINPUT_DAEMON;
         if (config.verbose) {
             std::cout << "✓ Используем uinput daemon (как ydotool)" << std::endl;
         }
-        return true;
-    }
-
-    // Метод 3: Прямой uinput (требует sudo)
-    if (tryDirectUinput()) {
-        active_method = METHOD_DIRECT_UINPUT;
+    } else {
         if (config.verbose) {
-            std::cout << "✓ Используем прямой uinput (требует sudo)" << std::endl;
+            std::cout << "✗ Не удалось инициализировать ни один метод" << std::endl;
         }
-        return true;
+        return false;
     }
 
-    if (config.verbose) {
-        std::cout << "✗ Не удалось инициализировать ни один метод" << std::endl;
+    // Поток вывода запускаем после fork() daemon'а, чтобы не копировать его в дочерний процесс
+    if (config.async_output) {
+        startOutputThread();
     }
-    return false;
+    return true;
 }
 
 void ScrollEmulator::cleanup() {
+    // Сначала дожидаемся вывода всех поставленных в очередь скроллов
+    stopOutputThread();
+
     if (socket_fd >= 0) {
         if (active_method == METHOD_UINPUT_DAEMON) {
-            sendDaemonCommand('Q', 0); // Quit
+            ScrollRecord quit = makeRecord(SCROLL_RECORD_QUIT, 0, 0, 0);
+            sendDaemonRecords(&quit, 1);
         }
         close(socket_fd);
         socket_fd = -1;
     }
 
-    if (daemon_pid > 0) {
-        kill(daemon_pid, SIGTERM);
-        waitpid(daemon_pid, nullptr, 0);
-        daemon_pid = -1;
+    detachSharedRing();
+
+    if (uinput_fd >= 0) {
+        ioctl(uinput_fd, 0x5502UL); // UI_DEV_DESTROY
+        close(uinput_fd);
+        uinput_fd = -1;
     }
 
-    unlink(socket_path.c_str());
+    closeX11Display();
+
+    if (frame_timer_fd >= 0) {
+        close(frame_timer_fd);
+        frame_timer_fd = -1;
+    }
+
+    // Daemon не останавливаем: он общий для всех клиентов и сам завершается
+    // после daemon_idle_timeout_s секунд без клиентов
 }
 
 bool ScrollEmulator::tryX11XTest() {
-    return false;
-    // // Проверяем что мы в X11 (не Wayland)
-    // if (getenv("WAYLAND_DISPLAY")) {
-    //     return false;
-    // }
+#ifdef HAVE_XTEST
+    // Под Wayland XTest доходит только до XWayland-окон
+    if (getenv("WAYLAND_DISPLAY")) {
+        return false;
+    }
+
+    if (!getenv("DISPLAY")) {
+        return false;
+    }
+
+    if (x11_display) {
+        return true;
+    }
+
+    // Одно соединение на всё время работы: шаг скролла - буферизованный запрос, а не процесс
+    Display* display = XOpenDisplay(nullptr);
+    if (!display) {
+        return false;
+    }
+
+    int event_base, error_base, major, minor;
+    if (!XTestQueryExtension(display, &event_base, &error_base, &major, &minor)) {
+        if (config.verbose) {
+            std::cout << "✗ X сервер не поддерживает расширение XTEST" << std::endl;
+        }
+        XCloseDisplay(display);
+        return false;
+    }
 
-    // if (!getenv("DISPLAY")) {
-    //     return false;
-    // }
+    x11_display = display;
+    return true;
+#else
+    // Собрано без libXtst
+    return false;
+#endif
+}
 
-    // // Проверяем наличие X11 библиотек через простой тест
-    // return system("command -v xset >/dev/null 2>&1") == 0;
+void ScrollEmulator::closeX11Display() {
+#ifdef HAVE_XTEST
+    if (x11_display) {
+        XCloseDisplay(static_cast<Display*>(x11_display));
+        x11_display = nullptr;
+    }
+#endif
 }
 
 bool ScrollEmulator::tryUinputDaemon() {
-    // Создаем daemon процесс (как ydotool)
-    daemon_pid = fork();
+    // Сначала подключаемся к уже работающему daemon'у - без fork и ожидания
+    if (connectToDaemon()) {
+        if (config.verbose) {
+            std::cout << "Подключились к работающему daemon'у " << socket_path << std::endl;
+        }
+    } else {
+        // Никто не слушает - запускаем daemon и ждем сигнала готовности
+        if (!spawnUinputDaemon() || !connectToDaemon()) {
+            return false;
+        }
+    }
 
-    if (daemon_pid == 0) {
-        // Дочерний процесс - daemon
-        runUinputDaemon();
-        _exit(0);
-    } else if (daemon_pid < 0) {
+    if (config.shared_memory_transport && !attachSharedRing() && config.verbose) {
+        std::cout << "Кольцо в общей памяти недоступно, используем сокет" << std::endl;
+    }
+    return true;
+}
+
+bool ScrollEmulator::spawnUinputDaemon() {
+    // Daemon сообщает о готовности байтом в pipe сразу после listen()
+    int ready_pipe[2];
+    if (pipe2(ready_pipe, O_CLOEXEC) < 0) return false;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(ready_pipe[0]);
+        close(ready_pipe[1]);
         return false;
     }
 
-    // Даем daemon'у время запуститься
-    usleep(200000); // 200ms
+    if (pid == 0) {
+        // Промежуточный процесс: отвязываемся от сессии клиента и
+        // запускаем daemon во втором fork, чтобы он не стал зомби
+        close(ready_pipe[0]);
+        setsid();
+        if (fork() == 0) {
+            // Клиент мог заблокировать сигналы для своего signalfd;
+            // daemon настраивает свою маску сам
+            sigset_t empty;
+            sigemptyset(&empty);
+            sigprocmask(SIG_SETMASK, &empty, nullptr);
+
+            int null_fd = open("/dev/null", O_RDWR);
+            if (null_fd >= 0) {
+                dup2(null_fd, STDIN_FILENO);
+                dup2(null_fd, STDOUT_FILENO);
+                dup2(null_fd, STDERR_FILENO);
+                if (null_fd > STDERR_FILENO) close(null_fd);
+            }
+            if (chdir("/") < 0) {
+                // Не критично
+            }
+            runUinputDaemon(config.daemon_idle_timeout_s, ready_pipe[1]);
+        }
+        _exit(0);
+    }
+
+    close(ready_pipe[1]);
+    waitpid(pid, nullptr, 0);
+
+    // Ждем готовности; EOF без байта означает, что daemon не смог запуститься
+    struct pollfd pfd;
+    pfd.fd = ready_pipe[0];
+    pfd.events = POLLIN;
+    char ready = 0;
+    bool ok = false;
+
+    int ret;
+    do {
+        ret = poll(&pfd, 1, 2000);
+    } while (ret < 0 && errno == EINTR);
 
-    // Подключаемся к daemon'у
-    return connectToDaemon();
+    if (ret > 0 && read(ready_pipe[0], &ready, 1) == 1) {
+        ok = true;
+    }
+    close(ready_pipe[0]);
+
+    if (!ok && config.verbose) {
+        std::cout << "✗ uinput daemon не сообщил о готовности" << std::endl;
+    }
+    return ok;
 }
 
 bool ScrollEmulator::tryDirectUinput() {
-    // Пробуем открыть uinput напрямую
-    const char* paths[] = {"/dev/uinput", "/dev/input/uinput", "/dev/misc/uinput"};
-
-    for (const char* path : paths) {
-        int fd = open(path, O_WRONLY | O_NONBLOCK);
-        if (fd >= 0) {
-            close(fd);
-            return true;
-        }
+    // Устройство создается один раз и живет до cleanup(): события пишутся
+    // прямо из процесса, без daemon'а и сокета
+    if (uinput_fd < 0) {
+        uinput_fd = openUinput();
     }
-    return false;
+    return uinput_fd >= 0;
 }
 
-void ScrollEmulator::runUinputDaemon() {
-    // Создаем unix socket
-    int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (server_fd < 0) return;
+bool ScrollEmulator::serveDaemon() {
+    if (config.verbose) {
+        std::cout << "Запуск uinput daemon'а на " << socket_path << std::endl;
+    }
+    return runUinputDaemon(0, -1);
+}
 
+bool ScrollEmulator::runUinputDaemon(int idle_timeout_s, int ready_fd) {
     struct sockaddr_un addr;
     memset(&addr, 0, sizeof(addr));
     addr.sun_family = AF_UNIX;
     strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
 
+    // Блокировка на время проверки и bind: два одновременно запущенных
+    // daemon'а не должны отбирать сокет друг у друга
+    std::string lock_path = socket_path + ".lock";
+    int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock_fd >= 0) {
+        flock(lock_fd, LOCK_EX);
+    }
+
+    // Если на сокете уже кто-то слушает - daemon уже работает, не перехватываем его
+    int probe_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe_fd >= 0) {
+        bool alive = connect(probe_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        close(probe_fd);
+        if (alive) {
+            if (config.verbose) {
+                std::cout << "Daemon уже запущен на " << socket_path << std::endl;
+            }
+            if (lock_fd >= 0) close(lock_fd);
+            // Для клиента, ждущего готовности, работающий daemon - тоже успех
+            notifyReady(ready_fd);
+            return false;
+        }
+    }
+
+    // Одно uinput устройство на всех клиентов. Без вывода daemon бесполезен:
+    // сокет не создаем и о готовности не сообщаем, чтобы клиент перешел
+    // к следующему методу, а не отдавал записи в никуда
+    int device_fd = openUinput();
+    if (device_fd < 0 && !tryX11XTest()) {
+        if (config.verbose) {
+            std::cout << "✗ Ни uinput, ни XTEST недоступны, daemon не запущен" << std::endl;
+        }
+        if (lock_fd >= 0) close(lock_fd);
+        return false;
+    }
+
+    auto releaseOutput = [&]() {
+        if (device_fd >= 0) {
+            ioctl(device_fd, 0x5502UL); // UI_DEV_DESTROY
+            close(device_fd);
+        }
+        closeX11Display();
+    };
+
+    // Создаем unix socket
+    int server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server_fd < 0) {
+        releaseOutput();
+        if (lock_fd >= 0) close(lock_fd);
+        return false;
+    }
+
     unlink(socket_path.c_str());
 
     if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
         close(server_fd);
-        return;
+        releaseOutput();
+        if (lock_fd >= 0) close(lock_fd);
+        return false;
     }
 
     // Устанавливаем права доступа для пользователя
     chmod(socket_path.c_str(), 0600);
 
-    if (listen(server_fd, 1) < 0) {
+    if (listen(server_fd, SOMAXCONN) < 0) {
         close(server_fd);
-        return;
+        unlink(socket_path.c_str());
+        releaseOutput();
+        if (lock_fd >= 0) close(lock_fd);
+        return false;
     }
 
-    // Принимаем соединение
-    int client_fd = accept(server_fd, nullptr, nullptr);
-    if (client_fd < 0) {
+    if (lock_fd >= 0) close(lock_fd);
+
+    // SIGINT/SIGTERM обрабатываем в цикле epoll, чтобы убрать за собой сокет
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        if (signal_fd >= 0) close(signal_fd);
         close(server_fd);
-        return;
+        unlink(socket_path.c_str());
+        releaseOutput();
+        return false;
     }
 
-    // Пытаемся открыть uinput
-    int uinput_fd = openUinput();
-
-    // Основной цикл daemon'а
-    char buffer[16];
-    while (true) {
-        int bytes = recv(client_fd, buffer, sizeof(buffer), 0);
-        if (bytes <= 0) break;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = server_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
+    if (signal_fd >= 0) {
+        ev.data.fd = signal_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev);
+    }
 
-        char command = buffer[0];
-        int steps = (bytes > 1) ? buffer[1] : 1;
+    // Сокет слушает - клиенты могут подключаться
+    notifyReady(ready_fd);
 
-        if (command == 'Q') break; // Quit
+    // Основной цикл daemon'а: клиенты мультиплексируются через epoll,
+    // у каждого свой буфер разбора кадров и, возможно, кольцо в общей памяти
+    std::unordered_map<int, DaemonClient> clients;
+    std::unordered_map<int, int> ring_owners; // eventfd -> сокет клиента
+    std::vector<ScrollRecord> records;
+    bool running = true;
 
-        if (uinput_fd >= 0) {
-            handleUinputCommand(uinput_fd, command, steps);
+    auto dispatch = [&](const ScrollRecord& record) {
+        if (device_fd >= 0) {
+            handleUinputRecord(device_fd, record);
         } else {
             // Fallback - пробуем X11 если uinput не работает
-            handleX11Fallback(command, steps);
+            handleX11Fallback(record);
         }
-    }
+    };
 
-    if (uinput_fd >= 0) {
-        ioctl(uinput_fd, 0x5502UL); // UI_DEV_DESTROY
-        close(uinput_fd);
+    // Из кольца принимаются только записи колесика, страниц и масштаба
+    auto dispatchRing = [&](DaemonClient& client) {
+        if (!client.ring) return;
+        std::vector<ScrollRecord> ring_records;
+        drainRing(client.ring, client.ring_capacity, ring_records);
+        for (const ScrollRecord& record : ring_records) {
+            if (record.type == SCROLL_RECORD_WHEEL || record.type == SCROLL_RECORD_PAGE ||
+                record.type == SCROLL_RECORD_ZOOM) {
+                dispatch(record);
+            }
+        }
+    };
+
+    auto dropClient = [&](int fd) {
+        std::unordered_map<int, DaemonClient>::iterator client = clients.find(fd);
+        if (client == clients.end()) return;
+        if (client->second.event_fd >= 0) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->second.event_fd, nullptr);
+            ring_owners.erase(client->second.event_fd);
+        }
+        detachRing(client->second);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        clients.erase(client);
+    };
+
+    while (running) {
+        // Без клиентов ждем не дольше idle_timeout_s, затем завершаемся
+        int timeout_ms = (idle_timeout_s > 0 && clients.empty()) ? idle_timeout_s * 1000 : -1;
+
+        struct epoll_event events[16];
+        int count = epoll_wait(epoll_fd, events, 16, timeout_ms);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (count == 0) {
+            running = false;
+            continue;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == signal_fd) {
+                struct signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {}
+                running = false;
+                continue;
+            }
+
+            if (fd == server_fd) {
+                // Принимаем всех ожидающих клиентов
+                int client_fd;
+                while ((client_fd = accept4(server_fd, nullptr, nullptr,
+                                            SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.fd = client_fd;
+                    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+                        close(client_fd);
+                        continue;
+                    }
+                    clients[client_fd] = DaemonClient();
+                }
+                continue;
+            }
+
+            // Пробуждение от клиента с кольцом в общей памяти
+            std::unordered_map<int, int>::iterator owner = ring_owners.find(fd);
+            if (owner != ring_owners.end()) {
+                uint64_t counter;
+                while (read(fd, &counter, sizeof(counter)) == sizeof(counter)) {}
+                dispatchRing(clients[owner->second]);
+                continue;
+            }
+
+            std::unordered_map<int, DaemonClient>::iterator client = clients.find(fd);
+            if (client == clients.end()) continue;
+
+            // Вычитываем все, что накопилось в сокете клиента
+            bool close_client = false;
+            char buffer[4096];
+            while (true) {
+                ssize_t bytes = recvWithFds(fd, buffer, sizeof(buffer), client->second.pending_fds);
+                if (bytes < 0 && errno == EINTR) continue;
+                if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (bytes <= 0) {
+                    close_client = true;
+                    break;
+                }
+                client->second.parser.feed(buffer, bytes);
+            }
+
+            // Записи из кольца созданы раньше, чем то, что пришло сейчас по сокету
+            dispatchRing(client->second);
+
+            records.clear();
+            if (!client->second.parser.parse(records)) {
+                close_client = true; // Нарушение протокола
+            }
+
+            for (const ScrollRecord& record : records) {
+                if (record.type == SCROLL_RECORD_QUIT) {
+                    // Quit завершает только этого клиента
+                    close_client = true;
+                    break;
+                }
+
+                if (record.type == SCROLL_RECORD_SHM_ATTACH) {
+                    if (attachRing(client->second, (uint32_t)record.delta)) {
+                        ev.events = EPOLLIN;
+                        ev.data.fd = client->second.event_fd;
+                        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->second.event_fd, &ev);
+                        ring_owners[client->second.event_fd] = fd;
+                    }
+                    continue;
+                }
+
+                dispatch(record);
+            }
+
+            if (close_client) {
+                dropClient(fd);
+            }
+        }
     }
 
-    close(client_fd);
+    releaseOutput();
+
+    while (!clients.empty()) {
+        dropClient(clients.begin()->first);
+    }
+    close(epoll_fd);
+    if (signal_fd >= 0) close(signal_fd);
     close(server_fd);
     unlink(socket_path.c_str());
+    return true;
+}
+
+void ScrollEmulator::notifyReady(int ready_fd) {
+    if (ready_fd < 0) return;
+
+    char ready = 1;
+    if (write(ready_fd, &ready, 1) < 0) {
+        // Клиент уже не ждет
+    }
+    close(ready_fd);
 }
 
 int ScrollEmulator::openUinput() {
@@ -211,6 +880,12 @@ bool ScrollEmulator::setupUinput(int fd) {
     if (ioctl(fd, 0x40045564UL, 2UL) < 0) return false; // UI_SET_EVBIT, EV_REL
     if (ioctl(fd, 0x40045566UL, 8UL) < 0) return false; // UI_SET_RELBIT, REL_WHEEL
     if (ioctl(fd, 0x40045566UL, 6UL) < 0) return false; // UI_SET_RELBIT, REL_HWHEEL
+    if (ioctl(fd, 0x40045566UL, 11UL) < 0) return false; // UI_SET_RELBIT, REL_WHEEL_HI_RES
+    if (ioctl(fd, 0x40045566UL, 12UL) < 0) return false; // UI_SET_RELBIT, REL_HWHEEL_HI_RES
+    if (ioctl(fd, 0x40045564UL, 1UL) < 0) return false; // UI_SET_EVBIT, EV_KEY
+    if (ioctl(fd, 0x40045565UL, 104UL) < 0) return false; // UI_SET_KEYBIT, KEY_PAGEUP
+    if (ioctl(fd, 0x40045565UL, 109UL) < 0) return false; // UI_SET_KEYBIT, KEY_PAGEDOWN
+    if (ioctl(fd, 0x40045565UL, 29UL) < 0) return false; // UI_SET_KEYBIT, KEY_LEFTCTRL
     if (ioctl(fd, 0x40045564UL, 0UL) < 0) return false; // UI_SET_EVBIT, EV_SYN
 
     struct input_id {
@@ -240,156 +915,418 @@ bool ScrollEmulator::setupUinput(int fd) {
     return true;
 }
 
-void ScrollEmulator::handleUinputCommand(int uinput_fd, char command, int steps) {
-    struct input_event {
-        unsigned long tv_sec;
-        unsigned long tv_usec;
-        unsigned short type;
-        unsigned short code;
-        int value;
-    };
+void ScrollEmulator::handleUinputRecord(int device_fd, const ScrollRecord& record) {
+    EventBatch batch(device_fd, uinput_write_failed);
+    int delta;
+    if (!recordDelta(record, delta)) return;
+
+    if (record.type == SCROLL_RECORD_PAGE) {
+        // Нажатие и отпускание клавиши - два кадра одной записью
+        unsigned short key = (delta > 0) ? 104 : 109; // KEY_PAGEUP / KEY_PAGEDOWN
+        batch.add(1, key, 1); // EV_KEY
+        batch.sync();
+        batch.add(1, key, 0);
+        batch.sync();
+        batch.flush();
+        return;
+    }
 
-    struct input_event event;
-    memset(&event, 0, sizeof(event));
+    if (record.type == SCROLL_RECORD_ZOOM) {
+        // Колесико между нажатием и отпусканием Ctrl - три кадра одной записью
+        batch.add(1, 29, 1); // EV_KEY, KEY_LEFTCTRL
+        batch.sync();
+        appendWheel(batch, true, delta, zoom_remainder);
+        batch.add(1, 29, 0);
+        batch.sync();
+        batch.flush();
+        return;
+    }
 
-    for (int i = 0; i < steps; i++) {
-        // Основное событие
-        event.type = 2; // EV_REL
+    if (record.type != SCROLL_RECORD_WHEEL) return;
 
-        switch (command) {
-            case 'U': // Up
-                event.code = 8; // REL_WHEEL
-                event.value = 1;
-                break;
-            case 'D': // Down
-                event.code = 8; // REL_WHEEL
-                event.value = -1;
-                break;
-            case 'L': // Left
-                event.code = 6; // REL_HWHEEL
-                event.value = -1;
-                break;
-            case 'R': // Right
-                event.code = 6; // REL_HWHEEL
-                event.value = 1;
-                break;
-            default:
-                continue;
+    bool vertical = (record.axis == SCROLL_AXIS_VERTICAL);
+    int& remainder = vertical ? wheel_remainder_v : wheel_remainder_h;
+
+    // Hi-res дельта выводится одним кадром
+    if (!(record.flags & SCROLL_FLAG_DETENTS)) {
+        appendWheel(batch, vertical, delta, remainder);
+        batch.flush();
+        return;
+    }
+
+    int steps = std::abs(delta) / HIRES_PER_DETENT;
+    int value = (delta > 0) ? HIRES_PER_DETENT : -HIRES_PER_DETENT;
+
+    // Политику объединения задает клиент во флагах записи: у общего
+    // daemon'а своей конфигурации для чужих команд нет
+    if (record.flags & SCROLL_FLAG_MERGE) {
+        // Все шаги одним кадром с суммарным значением
+        appendWheel(batch, vertical, value * steps, remainder);
+    } else {
+        // Отдельный кадр на каждый шаг, но одна запись на всю пачку.
+        // Паузы delay_ms между шагами выдерживает клиент (executeSteps):
+        // цикл daemon'а обслуживает всех клиентов и не спит
+        for (int i = 0; i < steps; i++) {
+            appendWheel(batch, vertical, value, remainder);
         }
+    }
+    batch.flush();
+}
+
+void ScrollEmulator::handleX11Fallback(const ScrollRecord& record) {
+    // Daemon без uinput выводит записи через XTEST, если есть X сервер
+    int delta;
+    if (!x11_display || !recordDelta(record, delta)) return;
+
+    if (record.type == SCROLL_RECORD_PAGE) {
+        executeX11PageScroll(delta > 0);
+        return;
+    }
+    if (record.type == SCROLL_RECORD_ZOOM) {
+        zoom_remainder += delta;
+        int detents = zoom_remainder / HIRES_PER_DETENT;
+        if (detents == 0) return;
+        zoom_remainder -= detents * HIRES_PER_DETENT;
+        executeX11Zoom(detents > 0, std::abs(detents));
+        return;
+    }
+    if (record.type != SCROLL_RECORD_WHEEL) return;
+
+    // Кнопки колесика X11 - только целые ступени, hi-res дельты копим
+    bool vertical = (record.axis == SCROLL_AXIS_VERTICAL);
+    int& remainder = vertical ? wheel_remainder_v : wheel_remainder_h;
+    remainder += delta;
+    int detents = remainder / HIRES_PER_DETENT;
+    if (detents == 0) return;
+    remainder -= detents * HIRES_PER_DETENT;
+
+    if (vertical) {
+        executeX11Scroll(detents > 0, std::abs(detents));
+    } else {
+        executeX11HorizontalScroll(detents > 0, std::abs(detents));
+    }
+}
+
+bool ScrollEmulator::connectToDaemon() {
+    socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_fd < 0) return false;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(socket_fd);
+        socket_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void ScrollEmulator::sendDaemonRecords(const ScrollRecord* records, size_t count) {
+    if (socket_fd < 0 || count == 0) return;
+
+    // Колесико и страницы идут через кольцо в общей памяти, если оно есть
+    if (shared_ring) {
+        while (count > 0 && records->type != SCROLL_RECORD_QUIT && pushSharedRing(*records)) {
+            records++;
+            count--;
+        }
+        if (count == 0) return;
+    }
+
+    // Весь кадр (заголовок + записи) уходит одним send()
+    char buffer[sizeof(ScrollFrameHeader) + SCROLL_PROTOCOL_MAX_RECORDS * sizeof(ScrollRecord)];
+
+    while (count > 0) {
+        size_t chunk = std::min(count, (size_t)SCROLL_PROTOCOL_MAX_RECORDS);
+
+        ScrollFrameHeader header;
+        header.magic = SCROLL_PROTOCOL_MAGIC;
+        header.version = SCROLL_PROTOCOL_VERSION;
+        header.record_count = (uint16_t)chunk;
+        memcpy(buffer, &header, sizeof(header));
+        memcpy(buffer + sizeof(header), records, chunk * sizeof(ScrollRecord));
+
+        size_t length = sizeof(header) + chunk * sizeof(ScrollRecord);
+        size_t sent = 0;
+        while (sent < length) {
+            ssize_t n = send(socket_fd, buffer + sent, length - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            sent += n;
+        }
+
+        records += chunk;
+        count -= chunk;
+    }
+}
+
+bool ScrollEmulator::attachSharedRing() {
+    size_t size = scrollRingSize(SCROLL_RING_CAPACITY);
+
+    int mem_fd = memfd_create("scroll_emulator_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (mem_fd < 0) return false;
+
+    // Daemon принимает только memfd с неизменяемым размером
+    if (ftruncate(mem_fd, size) < 0 ||
+        fcntl(mem_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+        close(mem_fd);
+        return false;
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+    if (memory == MAP_FAILED) {
+        close(mem_fd);
+        return false;
+    }
+
+    ScrollRingHeader* ring = static_cast<ScrollRingHeader*>(memory);
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+    ring->capacity = SCROLL_RING_CAPACITY;
+    // Daemon еще не подключил кольцо: первая запись должна его разбудить
+    ring->consumer_waiting.store(1, std::memory_order_relaxed);
+
+    int event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (event_fd < 0) {
+        munmap(memory, size);
+        close(mem_fd);
+        return false;
+    }
 
-        write(uinput_fd, &event, sizeof(event));
+    // Кадр SHM_ATTACH + memfd и eventfd в SCM_RIGHTS одним sendmsg()
+    char frame[sizeof(ScrollFrameHeader) + sizeof(ScrollRecord)];
+    ScrollFrameHeader header;
+    header.magic = SCROLL_PROTOCOL_MAGIC;
+    header.version = SCROLL_PROTOCOL_VERSION;
+    header.record_count = 1;
+    ScrollRecord record = makeRecord(SCROLL_RECORD_SHM_ATTACH, 0, SCROLL_RING_CAPACITY, 0);
+    memcpy(frame, &header, sizeof(header));
+    memcpy(frame + sizeof(header), &record, sizeof(record));
+
+    struct iovec iov;
+    iov.iov_base = frame;
+    iov.iov_len = sizeof(frame);
+
+    int fds[2] = { mem_fd, event_fd };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    close(mem_fd); // У daemon'а своя копия дескриптора
+
+    if (sent != (ssize_t)sizeof(frame)) {
+        munmap(memory, size);
+        close(event_fd);
+        return false;
+    }
 
-        // Событие синхронизации
-        event.type = 0; // EV_SYN
-        event.code = 0; // SYN_REPORT
-        event.value = 0;
-        write(uinput_fd, &event, sizeof(event));
+    shared_ring = ring;
+    ring_event_fd = event_fd;
 
-        if (i < steps - 1) usleep(config.delay_ms * 1000);
+    if (config.verbose) {
+        std::cout << "✓ Транспорт через общую память: " << SCROLL_RING_CAPACITY << " записей" << std::endl;
     }
+    return true;
 }
 
-void ScrollEmulator::handleX11Fallback(char command, int steps) {
-    (void)command; // Подавляем предупреждение о неиспользованном параметре
-    
-    // Fallback через X11 команды (как xdotool)
-    if (!getenv("DISPLAY")) return;
-
-    for (int i = 0; i < steps; i++) {
-        system("DISPLAY=$DISPLAY timeout 0.1 xset r on 2>/dev/null || true");
-        if (i < steps - 1) usleep(config.delay_ms * 1000);
+void ScrollEmulator::detachSharedRing() {
+    if (shared_ring) {
+        munmap(shared_ring, scrollRingSize(SCROLL_RING_CAPACITY));
+        shared_ring = nullptr;
+    }
+    if (ring_event_fd >= 0) {
+        close(ring_event_fd);
+        ring_event_fd = -1;
     }
 }
 
-bool ScrollEmulator::connectToDaemon() {
-    socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (socket_fd < 0) return false;
-
-    struct sockaddr_un addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+bool ScrollEmulator::pushSharedRing(const ScrollRecord& record) {
+    ScrollRingHeader* ring = shared_ring;
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
 
-    if (connect(socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        close(socket_fd);
-        socket_fd = -1;
-        return false;
+    // Кольцо заполнено: будим daemon и даем ему немного времени (до ~50мс)
+    for (int attempt = 0; head - ring->tail.load(std::memory_order_acquire) >= SCROLL_RING_CAPACITY; attempt++) {
+        if (attempt == 250) return false;
+        uint64_t one = 1;
+        if (write(ring_event_fd, &one, sizeof(one)) < 0) {
+            // Счетчик eventfd уже ненулевой
+        }
+        usleep(200);
     }
 
+    scrollRingRecords(ring)[head & (SCROLL_RING_CAPACITY - 1)] = record;
+    ring->head.store(head + 1, std::memory_order_release);
+
+    // Системный вызов только если daemon уснул на пустом кольце
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring->consumer_waiting.load(std::memory_order_relaxed) &&
+        ring->consumer_waiting.exchange(0, std::memory_order_acq_rel)) {
+        uint64_t one = 1;
+        if (write(ring_event_fd, &one, sizeof(one)) < 0) {
+            // Счетчик eventfd уже ненулевой
+        }
+    }
     return true;
 }
 
-void ScrollEmulator::sendDaemonCommand(char command, int steps) {
-    if (socket_fd < 0) return;
+uint16_t ScrollEmulator::detentFlags() const {
+    return SCROLL_FLAG_DETENTS | (config.coalescing == COALESCE_MERGE ? SCROLL_FLAG_MERGE : 0);
+}
 
-    char buffer[2] = { command, (char)steps };
-    send(socket_fd, buffer, 2, 0);
+void ScrollEmulator::sendDaemonWheel(bool vertical, int hires_value, bool detents) {
+    ScrollRecord record = makeRecord(SCROLL_RECORD_WHEEL,
+                                     vertical ? SCROLL_AXIS_VERTICAL : SCROLL_AXIS_HORIZONTAL,
+                                     hires_value, detents ? detentFlags() : 0);
+    sendDaemonRecords(&record, 1);
 }
 
 // Публичные методы API
 
 void ScrollEmulator::scrollUp(int steps) {
-    executeScroll(true, steps);
+    submitIntent({ScrollIntent::INTENT_STEP, true, true, steps, 0});
 }
 
 void ScrollEmulator::scrollDown(int steps) {
-    executeScroll(false, steps);
+    submitIntent({ScrollIntent::INTENT_STEP, true, false, steps, 0});
 }
 
 void ScrollEmulator::scrollLeft(int steps) {
-    executeHorizontalScroll(false, steps);
+    submitIntent({ScrollIntent::INTENT_STEP, false, false, steps, 0});
 }
 
 void ScrollEmulator::scrollRight(int steps) {
-    executeHorizontalScroll(true, steps);
+    submitIntent({ScrollIntent::INTENT_STEP, false, true, steps, 0});
 }
 
 void ScrollEmulator::smoothScrollUp(int distance, int duration_ms) {
-    executeSmoothScroll(true, true, distance, duration_ms);
+    submitIntent({ScrollIntent::INTENT_SMOOTH, true, true, distance * HIRES_PER_DETENT, duration_ms});
 }
 
 void ScrollEmulator::smoothScrollDown(int distance, int duration_ms) {
-    executeSmoothScroll(true, false, distance, duration_ms);
+    submitIntent({ScrollIntent::INTENT_SMOOTH, true, false, distance * HIRES_PER_DETENT, duration_ms});
 }
 
 void ScrollEmulator::smoothScrollLeft(int distance, int duration_ms) {
-    executeSmoothScroll(false, false, distance, duration_ms);
+    submitIntent({ScrollIntent::INTENT_SMOOTH, false, false, distance * HIRES_PER_DETENT, duration_ms});
 }
 
 void ScrollEmulator::smoothScrollRight(int distance, int duration_ms) {
-    executeSmoothScroll(false, true, distance, duration_ms);
+    submitIntent({ScrollIntent::INTENT_SMOOTH, false, true, distance * HIRES_PER_DETENT, duration_ms});
 }
 
-void ScrollEmulator::pageUp() {
-    executePageScroll(true);
+void ScrollEmulator::smoothScrollVertical(int hires_units, int duration_ms) {
+    if (hires_units != 0) {
+        submitIntent({ScrollIntent::INTENT_SMOOTH, true, hires_units > 0, std::abs(hires_units), duration_ms});
+    }
 }
 
-void ScrollEmulator::pageDown() {
-    executePageScroll(false);
+void ScrollEmulator::smoothScrollHorizontal(int hires_units, int duration_ms) {
+    if (hires_units != 0) {
+        submitIntent({ScrollIntent::INTENT_SMOOTH, false, hires_units > 0, std::abs(hires_units), duration_ms});
+    }
 }
 
-void ScrollEmulator::scrollToTop() {
-    if (config.verbose) {
-        std::cout << "Скролл в начало документа" << std::endl;
+void ScrollEmulator::flingVertical(float velocity) {
+    int hires = (int)std::lround(velocity * HIRES_PER_DETENT);
+    if (hires != 0) {
+        submitIntent({ScrollIntent::INTENT_FLING, true, hires > 0, std::abs(hires), 0});
     }
-    // Много Page Up для достижения верха
-    for (int i = 0; i < 20; i++) {
-        pageUp();
-        usleep(50000); // 50ms между нажатиями
+}
+
+void ScrollEmulator::flingHorizontal(float velocity) {
+    int hires = (int)std::lround(velocity * HIRES_PER_DETENT);
+    if (hires != 0) {
+        submitIntent({ScrollIntent::INTENT_FLING, false, hires > 0, std::abs(hires), 0});
     }
 }
 
-void ScrollEmulator::scrollToBottom() {
-    if (config.verbose) {
-        std::cout << "Скролл в конец документа" << std::endl;
+void ScrollEmulator::cancelScroll() {
+    // Без потока вывода анимации выполняются синхронно и к этому моменту завершены
+    if (!output_thread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        // Еще не начатые плавные, инерционные, пошаговые скроллы и серии
+        // Page Up/Down тоже отменяем: после отмены они начались бы заново
+        intent_queue.erase(std::remove_if(intent_queue.begin(), intent_queue.end(),
+                                          [](const ScrollIntent& intent) {
+                                              return intent.type == ScrollIntent::INTENT_SMOOTH ||
+                                                     intent.type == ScrollIntent::INTENT_FLING ||
+                                                     intent.type == ScrollIntent::INTENT_STEP ||
+                                                     intent.type == ScrollIntent::INTENT_PAGE ||
+                                                     intent.type == ScrollIntent::INTENT_EDGE;
+                                          }),
+                           intent_queue.end());
+        intent_queue.push_back({ScrollIntent::INTENT_CANCEL, true, true, 0, 0});
+        // Уже идущие серии шагов и Page Up/Down прерываются на ближайшей паузе
+        cancel_generation++;
     }
-    // Много Page Down для достижения низа
-    for (int i = 0; i < 20; i++) {
-        pageDown();
-        usleep(50000);
+    queue_cv.notify_one();
+    cancel_cv.notify_all();
+}
+
+void ScrollEmulator::scrollPreciseVertical(float distance) {
+    int hires = (int)std::lround(distance * HIRES_PER_DETENT);
+    if (hires != 0) {
+        submitIntent({ScrollIntent::INTENT_PRECISE, true, hires > 0, hires, 0});
+    }
+}
+
+void ScrollEmulator::scrollPreciseHorizontal(float distance) {
+    int hires = (int)std::lround(distance * HIRES_PER_DETENT);
+    if (hires != 0) {
+        submitIntent({ScrollIntent::INTENT_PRECISE, false, hires > 0, hires, 0});
+    }
+}
+
+void ScrollEmulator::zoom(int hires_units) {
+    if (hires_units != 0) {
+        submitIntent({ScrollIntent::INTENT_ZOOM, true, hires_units > 0, std::abs(hires_units), 0});
     }
 }
 
+void ScrollEmulator::pageUp() {
+    submitIntent({ScrollIntent::INTENT_PAGE, true, true, 1, 0});
+}
+
+void ScrollEmulator::pageDown() {
+    submitIntent({ScrollIntent::INTENT_PAGE, true, false, 1, 0});
+}
+
+void ScrollEmulator::scrollToTop() {
+    submitIntent({ScrollIntent::INTENT_EDGE, true, true, 1, 0});
+}
+
+void ScrollEmulator::scrollToBottom() {
+    submitIntent({ScrollIntent::INTENT_EDGE, true, false, 1, 0});
+}
+
+void ScrollEmulator::waitIdle() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    idle_cv.wait(lock, [this] { return intent_queue.empty() && !output_busy; });
+}
+
 const char* ScrollEmulator::getMethod() {
     switch (active_method) {
         case METHOD_X11_XTEST: return "X11 XTest";
@@ -403,18 +1340,45 @@ bool ScrollEmulator::isAvailable() {
     return active_method != METHOD_NONE;
 }
 
+bool ScrollEmulator::hasHiResOutput() const {
+    return active_method == METHOD_UINPUT_DAEMON || active_method == METHOD_DIRECT_UINPUT;
+}
+
 // Внутренние методы
 
+void ScrollEmulator::executeSteps(bool vertical, bool positive, int steps) {
+    // Без объединения кадров шаги разделяет пауза delay_ms. Ее выдерживает
+    // клиент (поток вывода или вызывающий поток), а daemon получает запись
+    // на каждый шаг и не задерживает остальных клиентов. С объединением
+    // записи не длиннее SCROLL_MAX_DETENTS_PER_RECORD ступеней и без пауз
+    bool paced = config.coalescing == COALESCE_NONE;
+    int chunk = paced ? 1 : (int)SCROLL_MAX_DETENTS_PER_RECORD;
+    unsigned long generation = cancelGeneration();
+
+    for (int done = 0; done < steps; done += chunk) {
+        if (done > 0 && paced && !pauseOutput(config.delay_ms, generation)) {
+            break; // cancelScroll(): оставшиеся шаги не выводим
+        }
+        int count = std::min(chunk, steps - done);
+        if (vertical) {
+            executeScroll(positive, count);
+        } else {
+            executeHorizontalScroll(positive, count);
+        }
+    }
+}
+
 void ScrollEmulator::executeScroll(bool up, int steps) {
     switch (active_method) {
         case METHOD_X11_XTEST:
             executeX11Scroll(up, steps);
             break;
         case METHOD_UINPUT_DAEMON:
-            sendDaemonCommand(up ? 'U' : 'D', steps);
+            sendDaemonWheel(true, (up ? 1 : -1) * steps * HIRES_PER_DETENT, true);
             break;
         case METHOD_DIRECT_UINPUT:
-            executeDirectUinput(up, steps);
+            executeDirectUinput(makeRecord(SCROLL_RECORD_WHEEL, SCROLL_AXIS_VERTICAL,
+                                           (up ? 1 : -1) * steps * HIRES_PER_DETENT, detentFlags()));
             break;
         default:
             if (config.verbose) {
@@ -429,14 +1393,11 @@ void ScrollEmulator::executeHorizontalScroll(bool right, int steps) {
             executeX11HorizontalScroll(right, steps);
             break;
         case METHOD_UINPUT_DAEMON:
-            sendDaemonCommand(right ? 'R' : 'L', steps);
+            sendDaemonWheel(false, (right ? 1 : -1) * steps * HIRES_PER_DETENT, true);
             break;
         case METHOD_DIRECT_UINPUT:
-            // Не реализовано для direct uinput
-            if (config.verbose) {
-                std::cout << "Горизонтальный скролл " << (right ? "вправо" : "влево")
-                         << " на " << steps << " шагов" << std::endl;
-            }
+            executeDirectUinput(makeRecord(SCROLL_RECORD_WHEEL, SCROLL_AXIS_HORIZONTAL,
+                                           (right ? 1 : -1) * steps * HIRES_PER_DETENT, detentFlags()));
             break;
         default:
             if (config.verbose) {
@@ -450,12 +1411,13 @@ void ScrollEmulator::executePageScroll(bool up) {
         case METHOD_X11_XTEST:
             executeX11PageScroll(up);
             break;
-        case METHOD_UINPUT_DAEMON:
-            sendDaemonCommand(up ? 'P' : 'N', 1);
+        case METHOD_UINPUT_DAEMON: {
+            ScrollRecord record = makeRecord(SCROLL_RECORD_PAGE, SCROLL_AXIS_VERTICAL, up ? 1 : -1, 0);
+            sendDaemonRecords(&record, 1);
             break;
+        }
         case METHOD_DIRECT_UINPUT:
-            // Эмулируем через много шагов колесика
-            executeDirectUinput(up, 5);
+            executeDirectUinput(makeRecord(SCROLL_RECORD_PAGE, SCROLL_AXIS_VERTICAL, up ? 1 : -1, 0));
             break;
         default:
             if (config.verbose) {
@@ -464,19 +1426,89 @@ void ScrollEmulator::executePageScroll(bool up) {
     }
 }
 
-void ScrollEmulator::executeX11Scroll(bool up, int steps) {
+void ScrollEmulator::executePreciseScroll(bool vertical, int hires_value) {
+    if (active_method == METHOD_UINPUT_DAEMON) {
+        sendDaemonWheel(vertical, hires_value, false);
+        return;
+    }
+    if (active_method == METHOD_DIRECT_UINPUT) {
+        executeDirectUinput(makeRecord(SCROLL_RECORD_WHEEL,
+                                       vertical ? SCROLL_AXIS_VERTICAL : SCROLL_AXIS_HORIZONTAL,
+                                       hires_value, 0));
+        return;
+    }
+
+    // Бэкенд умеет только целые ступени: копим остаток до полной ступени
+    int& remainder = vertical ? precise_remainder_v : precise_remainder_h;
+    remainder += hires_value;
+    int detents = remainder / HIRES_PER_DETENT;
+    if (detents == 0) return;
+    remainder -= detents * HIRES_PER_DETENT;
+
+    if (vertical) {
+        executeScroll(detents > 0, std::abs(detents));
+    } else {
+        executeHorizontalScroll(detents > 0, std::abs(detents));
+    }
+}
+
+void ScrollEmulator::executeZoom(int hires_value) {
+    switch (active_method) {
+        case METHOD_UINPUT_DAEMON: {
+            ScrollRecord record = makeRecord(SCROLL_RECORD_ZOOM, SCROLL_AXIS_VERTICAL, hires_value, 0);
+            sendDaemonRecords(&record, 1);
+            break;
+        }
+        case METHOD_DIRECT_UINPUT:
+            executeDirectUinput(makeRecord(SCROLL_RECORD_ZOOM, SCROLL_AXIS_VERTICAL, hires_value, 0));
+            break;
+        case METHOD_X11_XTEST: {
+            // Кнопки X11 - только целые ступени
+            zoom_remainder += hires_value;
+            int detents = zoom_remainder / HIRES_PER_DETENT;
+            if (detents == 0) return;
+            zoom_remainder -= detents * HIRES_PER_DETENT;
+            executeX11Zoom(detents > 0, std::abs(detents));
+            break;
+        }
+        default:
+            if (config.verbose) {
+                std::cout << "Масштабирование недоступно" << std::endl;
+            }
+    }
+}
+
+void ScrollEmulator::executeEdgeScroll(bool top) {
     if (config.verbose) {
-        std::cout << "X11 скролл " << (up ? "вверх" : "вниз") << " на " << steps << " шагов" << std::endl;
+        std::cout << (top ? "Скролл в начало документа" : "Скролл в конец документа") << std::endl;
+    }
+    // Много Page Up/Down для достижения края, cancelScroll() прерывает серию
+    unsigned long generation = cancelGeneration();
+    for (int i = 0; i < 20; i++) {
+        executePageScroll(top);
+        if (!pauseOutput(50, generation)) break; // 50ms между нажатиями
     }
+}
 
-    for (int i = 0; i < steps; i++) {
-        char cmd[64];
-        snprintf(cmd, sizeof(cmd), "DISPLAY=%s timeout 0.1 xset -display %s r on 2>/dev/null || true",
-                 getenv("DISPLAY") ?: ":0", getenv("DISPLAY") ?: ":0");
-        system(cmd);
+unsigned long ScrollEmulator::cancelGeneration() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return cancel_generation;
+}
 
-        if (i < steps - 1) usleep(config.delay_ms * 1000);
+bool ScrollEmulator::pauseOutput(int delay_ms, unsigned long generation) {
+    // Пауза между шагами, которую прерывает cancelScroll(); false - отменено
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    cancel_cv.wait_for(lock, std::chrono::milliseconds(std::max(0, delay_ms)),
+                       [this, generation] { return cancel_generation != generation; });
+    return cancel_generation == generation;
+}
+
+void ScrollEmulator::executeX11Scroll(bool up, int steps) {
+    if (config.verbose) {
+        std::cout << "X11 скролл " << (up ? "вверх" : "вниз") << " на " << steps << " шагов" << std::endl;
     }
+
+    executeX11Buttons(up ? 4 : 5, steps); // Button4 / Button5
 }
 
 void ScrollEmulator::executeX11HorizontalScroll(bool right, int steps) {
@@ -485,14 +1517,7 @@ void ScrollEmulator::executeX11HorizontalScroll(bool right, int steps) {
                  << " на " << steps << " шагов" << std::endl;
     }
 
-    for (int i = 0; i < steps; i++) {
-        char cmd[64];
-        snprintf(cmd, sizeof(cmd), "DISPLAY=%s timeout 0.1 xset -display %s r on 2>/dev/null || true",
-                 getenv("DISPLAY") ?: ":0", getenv("DISPLAY") ?: ":0");
-        system(cmd);
-
-        if (i < steps - 1) usleep(config.delay_ms * 1000);
-    }
+    executeX11Buttons(right ? 7 : 6, steps); // Button6 - влево, Button7 - вправо
 }
 
 void ScrollEmulator::executeX11PageScroll(bool up) {
@@ -500,22 +1525,74 @@ void ScrollEmulator::executeX11PageScroll(bool up) {
         std::cout << "X11 " << (up ? "Page Up" : "Page Down") << std::endl;
     }
 
-    const char* key = up ? "Prior" : "Next";
-    char cmd[128];
-    snprintf(cmd, sizeof(cmd), "DISPLAY=%s timeout 0.1 xset -display %s key %s 2>/dev/null || true",
-             getenv("DISPLAY") ?: ":0", getenv("DISPLAY") ?: ":0", key);
-    system(cmd);
+#ifdef HAVE_XTEST
+    Display* display = static_cast<Display*>(x11_display);
+    if (!display) return;
+
+    KeyCode key = XKeysymToKeycode(display, up ? XK_Prior : XK_Next);
+    if (key == 0) return;
+
+    XTestFakeKeyEvent(display, key, True, CurrentTime);
+    XTestFakeKeyEvent(display, key, False, CurrentTime);
+    XFlush(display);
+#endif
 }
 
-void ScrollEmulator::executeDirectUinput(bool up, int steps) {
+void ScrollEmulator::executeX11Zoom(bool in, int steps) {
     if (config.verbose) {
-        std::cout << "Direct uinput скролл " << (up ? "вверх" : "вниз")
-                 << " на " << steps << " шагов" << std::endl;
+        std::cout << "X11 масштаб " << (in ? "+" : "-") << steps << std::endl;
     }
-    // Здесь был бы код как в оригинальном uinput примере
+
+#ifdef HAVE_XTEST
+    Display* display = static_cast<Display*>(x11_display);
+    if (!display) return;
+
+    KeyCode ctrl = XKeysymToKeycode(display, XK_Control_L);
+    if (ctrl == 0) return;
+
+    // Ctrl держим на все ступени, иначе между ними приложение видит обычный скролл
+    XTestFakeKeyEvent(display, ctrl, True, CurrentTime);
+    for (int i = 0; i < steps; i++) {
+        XTestFakeButtonEvent(display, in ? 4 : 5, True, CurrentTime);
+        XTestFakeButtonEvent(display, in ? 4 : 5, False, CurrentTime);
+    }
+    XTestFakeKeyEvent(display, ctrl, False, CurrentTime);
+    XFlush(display);
+#endif
+}
+
+void ScrollEmulator::executeX11Buttons(unsigned int button, int steps) {
+#ifdef HAVE_XTEST
+    Display* display = static_cast<Display*>(x11_display);
+    if (!display) return;
+
+    // Ступень колесика в X11 - нажатие и отпускание кнопки. Запросы копятся
+    // в буфере Xlib и уходят одним XFlush на кадр; склеить несколько ступеней
+    // в одно событие нельзя, поэтому MERGE ведет себя как BURST. Паузы
+    // между шагами выдерживает executeSteps - здесь может быть и daemon
+    for (int i = 0; i < steps; i++) {
+        XTestFakeButtonEvent(display, button, True, CurrentTime);
+        XTestFakeButtonEvent(display, button, False, CurrentTime);
+    }
+    XFlush(display);
+#else
+    (void)button;
+    (void)steps;
+#endif
+}
+
+void ScrollEmulator::executeDirectUinput(const ScrollRecord& record) {
+    if (uinput_fd < 0) return;
+
+    if (config.verbose && (record.flags & SCROLL_FLAG_DETENTS)) {
+        std::cout << "Direct uinput скролл на " << record.delta / HIRES_PER_DETENT
+                  << " шагов" << std::endl;
+    }
+    // Та же обработка записи, что и в daemon'е, но без сокета и переключения контекста
+    handleUinputRecord(uinput_fd, record);
 }
 
-void ScrollEmulator::executeSmoothScroll(bool vertical, bool positive, int distance, int duration_ms) {
+void ScrollEmulator::executeSmoothScroll(bool vertical, bool positive, int hires_distance, int duration_ms) {
     if (config.verbose) {
         std::cout << "Плавный скролл ";
         if (vertical) {
@@ -523,49 +1600,380 @@ void ScrollEmulator::executeSmoothScroll(bool vertical, bool positive, int dista
         } else {
             std::cout << (positive ? "вправо" : "влево");
         }
-        std::cout << " на " << distance << " за " << duration_ms << "мс" << std::endl;
+        std::cout << " на " << (float)hires_distance / HIRES_PER_DETENT
+                  << " за " << duration_ms << "мс" << std::endl;
+    }
+
+    if (hires_distance <= 0) return;
+
+    if (!animation_v.active && !animation_h.active) {
+        startFrameClock(config.frame_rate_hz);
+    }
+    long delta = positive ? hires_distance : -(long)hires_distance;
+    retargetAnimation(vertical, delta, duration_ms, frame_deadline_ns - frame_period_ns);
+    runAnimations();
+}
+
+void ScrollEmulator::executeFling(bool vertical, int hires_velocity) {
+    if (!config.kinetic_scrolling) return;
+
+    if (config.verbose) {
+        std::cout << "Инерционный скролл со скоростью " << (float)hires_velocity / HIRES_PER_DETENT
+                  << " ступеней/с" << std::endl;
+    }
+
+    // Скорость затухает как v(t) = v0 * e^(-t/tau); инерция заканчивается,
+    // когда скорость падает ниже четверти ступени в секунду
+    double decay_ns = std::max(1, config.fling_time_constant_ms) * 1e6;
+    double speed = std::abs(hires_velocity);
+    double stop_speed = HIRES_PER_DETENT / 4.0;
+    if (speed <= stop_speed) return;
+
+    double duration_ns = decay_ns * std::log(speed / stop_speed);
+    double distance = hires_velocity * 1e-9 * decay_ns * (1.0 - stop_speed / speed);
+
+    if (!animation_v.active && !animation_h.active) {
+        startFrameClock(config.frame_rate_hz);
+    }
+    uint64_t now_ns = frame_deadline_ns - frame_period_ns;
+
+    // Непройденный остаток плавного скролла по этой оси сохраняется
+    AxisAnimation& animation = vertical ? animation_v : animation_h;
+    if (animation.active) {
+        animation.from = animationPosition(animation, now_ns);
+    } else {
+        animation.active = true;
+        animation.emitted = 0;
+        animation.target = 0;
+        animation.from = 0.0;
+    }
+    animation.target += std::lround(distance);
+    animation.velocity = 0.0;
+    animation.decay_ns = decay_ns;
+    animation.start_ns = now_ns;
+    animation.duration_ns = (uint64_t)duration_ns;
+
+    runAnimations();
+}
+
+void ScrollEmulator::runAnimations() {
+    // В потоке вывода анимацию ведет outputLoop(), сливая с ней следующие намерения
+    if (std::this_thread::get_id() == output_thread.get_id()) return;
+
+    // Синхронный режим: выполняем анимацию до конца в вызывающем потоке
+    while (advanceAnimations(waitFrame())) {}
+    stopFrameClock();
+}
+
+void ScrollEmulator::retargetAnimation(bool vertical, long delta, int duration_ms, uint64_t now_ns) {
+    AxisAnimation& animation = vertical ? animation_v : animation_h;
+
+    if (animation.active) {
+        // Продолжаем с текущей точки кривой; скорость оцениваем по последнему кадру
+        // (несколько намерений за один кадр сохраняют уже оцененную скорость)
+        uint64_t dt = std::min<uint64_t>(frame_period_ns, now_ns - animation.start_ns);
+        double position = animationPosition(animation, now_ns);
+        if (dt > 0) {
+            animation.velocity = (position - animationPosition(animation, now_ns - dt)) / dt;
+        }
+        animation.from = position;
+        animation.target += delta;
+    } else {
+        animation.active = true;
+        animation.emitted = 0;
+        animation.target = delta;
+        animation.from = 0.0;
+        animation.velocity = 0.0;
     }
 
-    // Рассчитываем количество шагов и задержки для плавности
-    int total_steps = distance * config.smooth_steps;
-    int step_delay = duration_ms / total_steps;
+    animation.decay_ns = 0.0;
+    animation.start_ns = now_ns;
+    animation.duration_ns = (uint64_t)std::max(0, duration_ms) * 1000000ULL;
+}
 
-    // Минимальная задержка 1мс, максимальная 100мс
-    step_delay = std::max(1, std::min(step_delay, 100));
+double ScrollEmulator::animationPosition(const AxisAnimation& animation, uint64_t now_ns) const {
+    if (now_ns <= animation.start_ns) return animation.from;
+    if (now_ns - animation.start_ns >= animation.duration_ns) return animation.target;
+
+    // Инерция: экспоненциальное затухание, нормированное так, что к концу
+    // отрезка пройден ровно весь путь
+    if (animation.decay_ns > 0.0) {
+        double t = (double)(now_ns - animation.start_ns);
+        double k = (1.0 - std::exp(-t / animation.decay_ns)) /
+                   (1.0 - std::exp(-(double)animation.duration_ns / animation.decay_ns));
+        return animation.from + (animation.target - animation.from) * k;
+    }
 
-    for (int i = 0; i < total_steps; i++) {
-        // Применяем ускорение (ease-in-out)
-        float progress = (float)i / total_steps;
-        float ease_factor = config.acceleration;
+    double s = (double)(now_ns - animation.start_ns) / animation.duration_ns;
+    double exponent = config.acceleration > 0.0f ? config.acceleration : 1.0;
+    double distance = animation.target - animation.from;
 
-        if (ease_factor != 1.0f) {
-            // Простая функция ease-in-out
-            if (progress < 0.5f) {
-                ease_factor *= 2.0f * progress * progress;
-            } else {
-                ease_factor *= 1.0f - 2.0f * (progress - 0.5f) * (progress - 0.5f);
+    // С места - кривая p(s) = s^acceleration
+    if (animation.velocity == 0.0) {
+        return animation.from + distance * std::pow(s, exponent);
+    }
+
+    // После перепланирования - кубический Эрмит: начальная скорость равна
+    // скорости прерванного отрезка, конечная - как у кривой s^acceleration
+    double m0 = animation.velocity * animation.duration_ns;
+    double m1 = exponent * distance;
+    double s2 = s * s;
+    double s3 = s2 * s;
+    return (2 * s3 - 3 * s2 + 1) * animation.from + (s3 - 2 * s2 + s) * m0 +
+           (-2 * s3 + 3 * s2) * animation.target + (s3 - s2) * m1;
+}
+
+bool ScrollEmulator::advanceAnimations(uint64_t frame_ns) {
+    // С hi-res осями кадр сдвигает на долю ступени, иначе промежуточные
+    // кадры выводят только целые ступени
+    long quantum = hasHiResOutput() ? 1 : HIRES_PER_DETENT;
+
+    AxisAnimation* animations[2] = { &animation_v, &animation_h };
+    for (int axis = 0; axis < 2; axis++) {
+        AxisAnimation& animation = *animations[axis];
+        if (!animation.active) continue;
+
+        // Выводим то, что положено к этому дедлайну, а не фиксированный шаг:
+        // опоздавший кадр догоняет пропущенное
+        bool finished = frame_ns - animation.start_ns >= animation.duration_ns;
+        long owed = finished ? animation.target - animation.emitted
+                             : (long)animationPosition(animation, frame_ns) - animation.emitted;
+        // Последний кадр выводит весь остаток, даже меньше ступени: hi-res
+        // бэкенд выведет его как есть, остальные накопят его в
+        // executePreciseScroll до целой ступени
+        if (!finished) {
+            owed -= owed % quantum;
+        }
+
+        if (owed != 0) {
+            executePreciseScroll(axis == 0, (int)owed);
+            animation.emitted += owed;
+        }
+        if (finished) {
+            animation.active = false;
+        }
+    }
+
+    return animation_v.active || animation_h.active;
+}
+
+void ScrollEmulator::startFrameClock(int rate_hz) {
+    rate_hz = std::max(1, std::min(rate_hz, 1000));
+    frame_period_ns = 1000000000ULL / rate_hz;
+    frame_deadline_ns = monotonicNanos() + frame_period_ns;
+
+    if (frame_timer_fd < 0) {
+        frame_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    }
+    if (frame_timer_fd < 0) return; // Будем спать до абсолютных дедлайнов
+
+    // Период задает ядро: дедлайны не сдвигаются от времени вывода кадра
+    struct itimerspec spec;
+    spec.it_value = toTimespec(frame_deadline_ns);
+    spec.it_interval = toTimespec(frame_period_ns);
+    timerfd_settime(frame_timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+uint64_t ScrollEmulator::waitFrame() {
+    // Возвращает время последнего наступившего дедлайна; если кадр опоздал,
+    // пропущенные дедлайны не выводятся по отдельности
+    uint64_t expirations = 0;
+    if (frame_timer_fd >= 0) {
+        ssize_t n;
+        do {
+            n = read(frame_timer_fd, &expirations, sizeof(expirations));
+        } while (n < 0 && errno == EINTR);
+        if (n != sizeof(expirations)) expirations = 0;
+    }
+
+    if (expirations == 0) {
+        struct timespec deadline = toTimespec(frame_deadline_ns);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {}
+        expirations = 1 + (monotonicNanos() - frame_deadline_ns) / frame_period_ns;
+    }
+
+    frame_deadline_ns += expirations * frame_period_ns;
+    return frame_deadline_ns - frame_period_ns;
+}
+
+void ScrollEmulator::stopFrameClock() {
+    if (frame_timer_fd < 0) return;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    timerfd_settime(frame_timer_fd, 0, &spec, nullptr);
+}
+
+// Поток вывода
+
+void ScrollEmulator::startOutputThread() {
+    if (output_thread.joinable()) return;
+
+    output_running = true;
+    output_thread = std::thread(&ScrollEmulator::outputLoop, this);
+}
+
+void ScrollEmulator::stopOutputThread() {
+    if (!output_thread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        output_running = false;
+    }
+    queue_cv.notify_all();
+    output_thread.join();
+
+    // Настройки, заданные после последнего намерения
+    if (config_changed) {
+        config = requested_config;
+        config_changed = false;
+    }
+
+    if (config.verbose && dropped_intents > 0) {
+        std::cout << "Отброшено намерений скролла из-за переполнения очереди: "
+                  << dropped_intents << std::endl;
+    }
+}
+
+void ScrollEmulator::submitIntent(const ScrollIntent& intent) {
+    if (!output_thread.joinable()) {
+        // Синхронный режим: выполняем в вызывающем потоке
+        executeIntent(intent);
+        return;
+    }
+
+    // Жертвовать при переполнении можно только движением: отмена, страницы,
+    // край и масштаб должны дойти до вывода
+    auto is_motion = [](const ScrollIntent& queued) {
+        return queued.type == ScrollIntent::INTENT_SMOOTH || queued.type == ScrollIntent::INTENT_PRECISE;
+    };
+    // У SMOOTH модуль в amount и знак в positive, у PRECISE amount со знаком
+    auto signed_amount = [](const ScrollIntent& queued) {
+        return (queued.type == ScrollIntent::INTENT_SMOOTH && !queued.positive) ? -(long)queued.amount
+                                                                                : (long)queued.amount;
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        size_t capacity = static_cast<size_t>(std::max(1, requested_config.queue_capacity));
+        bool queued = false;
+
+        if (intent_queue.size() >= capacity && is_motion(intent)) {
+            // Очередь полна: сливаем движение с последним таким же намерением
+            // по той же оси (не раньше отмены) - путь сохраняется без нового места
+            for (std::deque<ScrollIntent>::reverse_iterator it = intent_queue.rbegin();
+                 it != intent_queue.rend() && it->type != ScrollIntent::INTENT_CANCEL; ++it) {
+                if (it->type != intent.type || it->vertical != intent.vertical) continue;
+
+                long sum = signed_amount(*it) + signed_amount(intent);
+                sum = std::max<long>(-INT32_MAX, std::min<long>(INT32_MAX, sum));
+                it->positive = sum > 0;
+                it->amount = (int)(it->type == ScrollIntent::INTENT_SMOOTH ? std::abs(sum) : sum);
+                it->duration_ms = intent.duration_ms;
+                if (sum == 0) {
+                    intent_queue.erase(std::next(it).base());
+                }
+                queued = true;
+                break;
             }
         }
 
-        // Делаем один шаг скролла
-        if (vertical) {
-            if (positive) {
-                executeScroll(true, 1);
-            } else {
-                executeScroll(false, 1);
+        if (!queued) {
+            // Иначе теряем самое старое движение; управляющие намерения
+            // не вытесняются и при заполненной очереди все равно ставятся
+            while (intent_queue.size() >= capacity) {
+                std::deque<ScrollIntent>::iterator oldest =
+                    std::find_if(intent_queue.begin(), intent_queue.end(), is_motion);
+                if (oldest == intent_queue.end()) break;
+                intent_queue.erase(oldest);
+                dropped_intents++;
             }
-        } else {
-            if (positive) {
-                executeHorizontalScroll(true, 1);
+            if (intent_queue.size() >= capacity && is_motion(intent)) {
+                dropped_intents++;
             } else {
-                executeHorizontalScroll(false, 1);
+                intent_queue.push_back(intent);
             }
         }
+    }
+    queue_cv.notify_one();
+}
+
+void ScrollEmulator::executeIntent(const ScrollIntent& intent) {
+    switch (intent.type) {
+        case ScrollIntent::INTENT_STEP:
+            executeSteps(intent.vertical, intent.positive, intent.amount);
+            break;
+        case ScrollIntent::INTENT_SMOOTH:
+            executeSmoothScroll(intent.vertical, intent.positive, intent.amount, intent.duration_ms);
+            break;
+        case ScrollIntent::INTENT_PRECISE:
+            executePreciseScroll(intent.vertical, intent.amount);
+            break;
+        case ScrollIntent::INTENT_PAGE:
+            executePageScroll(intent.positive);
+            break;
+        case ScrollIntent::INTENT_EDGE:
+            executeEdgeScroll(intent.positive);
+            break;
+        case ScrollIntent::INTENT_FLING:
+            executeFling(intent.vertical, intent.positive ? intent.amount : -intent.amount);
+            break;
+        case ScrollIntent::INTENT_CANCEL:
+            // Уже выведенное не откатываем, просто прекращаем движение
+            animation_v.active = false;
+            animation_h.active = false;
+            stopFrameClock();
+            break;
+        case ScrollIntent::INTENT_ZOOM:
+            executeZoom(intent.positive ? intent.amount : -intent.amount);
+            break;
+    }
+}
+
+void ScrollEmulator::outputLoop() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    bool animating = false;
+
+    while (true) {
+        // Без анимации спим до нового намерения; во время анимации
+        // забираем накопившиеся намерения на каждом кадре
+        if (!animating) {
+            queue_cv.wait(lock, [this] { return !intent_queue.empty() || !output_running; });
+
+            // При остановке дорабатываем оставшуюся очередь
+            if (intent_queue.empty()) break;
+        }
+
+        std::deque<ScrollIntent> pending;
+        pending.swap(intent_queue);
+        if (config_changed) {
+            config = requested_config;
+            config_changed = false;
+        }
+        output_busy = true;
+        lock.unlock();
+
+        // Плавные намерения не блокируют поток, а перепланируют анимацию оси
+        for (const ScrollIntent& intent : pending) {
+            executeIntent(intent);
+        }
+
+        animating = animation_v.active || animation_h.active;
+        if (animating) {
+            animating = advanceAnimations(waitFrame());
+            if (!animating) stopFrameClock();
+        }
 
-        // Задержка с учетом ускорения
-        int adjusted_delay = (int)(step_delay * ease_factor);
-        usleep(adjusted_delay * 1000);
+        lock.lock();
+        if (!animating) {
+            output_busy = false;
+            if (intent_queue.empty()) {
+                idle_cv.notify_all();
+            }
+        }
     }
+
+    idle_cv.notify_all();
 }
 
 // C API реализация
@@ -597,6 +2005,20 @@ extern "C" {
         e->setConfig(cfg);
     }
 
+    void scroll_emulator_set_coalescing(void* emulator, int coalescing) {
+        ScrollEmulator* e = static_cast<ScrollEmulator*>(emulator);
+        ScrollEmulator::ScrollConfig cfg = e->getConfig();
+        cfg.coalescing = static_cast<ScrollEmulator::FrameCoalescing>(coalescing);
+        e->setConfig(cfg);
+    }
+
+    void scroll_emulator_set_frame_rate(void* emulator, int rate_hz) {
+        ScrollEmulator* e = static_cast<ScrollEmulator*>(emulator);
+        ScrollEmulator::ScrollConfig cfg = e->getConfig();
+        cfg.frame_rate_hz = rate_hz;
+        e->setConfig(cfg);
+    }
+
     void scroll_emulator_set_verbose(void* emulator, int verbose) {
         ScrollEmulator* e = static_cast<ScrollEmulator*>(emulator);
         ScrollEmulator::ScrollConfig cfg = e->getConfig();
@@ -636,6 +2058,38 @@ extern "C" {
         static_cast<ScrollEmulator*>(emulator)->smoothScrollRight(distance, duration_ms);
     }
 
+    void scroll_emulator_smooth_vertical(void* emulator, int hires_units, int duration_ms) {
+        static_cast<ScrollEmulator*>(emulator)->smoothScrollVertical(hires_units, duration_ms);
+    }
+
+    void scroll_emulator_smooth_horizontal(void* emulator, int hires_units, int duration_ms) {
+        static_cast<ScrollEmulator*>(emulator)->smoothScrollHorizontal(hires_units, duration_ms);
+    }
+
+    void scroll_emulator_fling_vertical(void* emulator, float velocity) {
+        static_cast<ScrollEmulator*>(emulator)->flingVertical(velocity);
+    }
+
+    void scroll_emulator_fling_horizontal(void* emulator, float velocity) {
+        static_cast<ScrollEmulator*>(emulator)->flingHorizontal(velocity);
+    }
+
+    void scroll_emulator_cancel(void* emulator) {
+        static_cast<ScrollEmulator*>(emulator)->cancelScroll();
+    }
+
+    void scroll_emulator_precise_vertical(void* emulator, float distance) {
+        static_cast<ScrollEmulator*>(emulator)->scrollPreciseVertical(distance);
+    }
+
+    void scroll_emulator_precise_horizontal(void* emulator, float distance) {
+        static_cast<ScrollEmulator*>(emulator)->scrollPreciseHorizontal(distance);
+    }
+
+    void scroll_emulator_zoom(void* emulator, int hires_units) {
+        static_cast<ScrollEmulator*>(emulator)->zoom(hires_units);
+    }
+
     void scroll_emulator_page_up(void* emulator) {
         static_cast<ScrollEmulator*>(emulator)->pageUp();
     }
@@ -652,6 +2106,14 @@ extern "C" {
         static_cast<ScrollEmulator*>(emulator)->scrollToBottom();
     }
 
+    void scroll_emulator_wait_idle(void* emulator) {
+        static_cast<ScrollEmulator*>(emulator)->waitIdle();
+    }
+
+    int scroll_emulator_serve_daemon(void* emulator) {
+        return static_cast<ScrollEmulator*>(emulator)->serveDaemon() ? 1 : 0;
+    }
+
     const char* scroll_emulator_get_method(void* emulator) {
         return static_cast<ScrollEmulator*>(emulator)->getMethod();
     }
@@ -2,6 +2,15 @@
 #define SCROLL_EMULATOR_H
 
 #include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+struct ScrollRecord;
+struct ScrollRingHeader;
 
 // Класс для эмуляции скролла без sudo
 class ScrollEmulator {
@@ -13,19 +22,100 @@ public:
         METHOD_DIRECT_UINPUT
     };
 
+    // Объединение шагов одной команды в кадры uinput
+    enum FrameCoalescing {
+        COALESCE_NONE = 0,  // Кадр на каждый шаг, пауза delay_ms между кадрами (у клиента)
+        COALESCE_BURST,     // Кадр на каждый шаг, вся пачка одной записью без пауз
+        COALESCE_MERGE      // Все шаги одним кадром с суммарным значением
+    };
+
     struct ScrollConfig {
         int delay_ms = 50;          // Задержка между шагами (мс)
-        int smooth_steps = 1;       // Количество промежуточных шагов для плавности
-        float acceleration = 1.0f;  // Ускорение (1.0 = постоянная скорость)
+        int smooth_steps = 1;       // Устарело: hi-res вывод всегда дробный, плавность задает frame_rate_hz
+        float acceleration = 1.0f;  // Ускорение: путь p(s) = s^acceleration (1.0 = постоянная скорость)
+        int frame_rate_hz = 120;    // Частота кадров плавного скролла (60/120/240...)
         bool verbose = false;       // Подробный вывод
+        FrameCoalescing coalescing = COALESCE_NONE; // Политика объединения кадров uinput
+        bool async_output = true;   // Выполнять скроллы в отдельном потоке вывода
+        int queue_capacity = 32;    // Максимальное количество намерений в очереди
+        int daemon_idle_timeout_s = 600; // Запущенный daemon завершается после простоя без клиентов
+        bool shared_memory_transport = false; // Передавать записи daemon'у через кольцо в общей памяти
+        bool kinetic_scrolling = true;         // Инерционный скролл после отрыва пальцев
+        int fling_time_constant_ms = 325;      // Постоянная времени затухания инерции
     };
 
 private:
+    // Намерение скролла, передаваемое в поток вывода
+    struct ScrollIntent {
+        enum Type {
+            INTENT_STEP,    // Простой скролл на amount шагов
+            INTENT_SMOOTH,  // Плавный скролл на amount hi-res единиц за duration_ms
+            INTENT_PRECISE, // Hi-res скролл на amount единиц (1/120 ступени, со знаком)
+            INTENT_PAGE,    // Page Up / Page Down
+            INTENT_EDGE,    // В начало / в конец документа
+            INTENT_FLING,   // Инерция со скоростью amount hi-res единиц в секунду
+            INTENT_CANCEL,  // Остановить анимации
+            INTENT_ZOOM     // Ctrl + колесико на amount hi-res единиц (масштаб)
+        };
+
+        Type type;
+        bool vertical;
+        bool positive;
+        int amount;
+        int duration_ms;
+    };
+
+    // Плавный скролл по одной оси. Новое намерение не ставится в очередь за
+    // текущим, а добавляется к оставшемуся пути: кривая перепланируется от
+    // текущей позиции и скорости, поэтому вывод успевает за пальцами
+    struct AxisAnimation {
+        bool active;
+        long target;            // Конечная позиция (hi-res единицы от начала анимации)
+        long emitted;           // Уже выведено
+        double from;            // Позиция в начале отрезка
+        double velocity;        // Скорость в начале отрезка (единиц/нс), 0 - старт с места
+        double decay_ns;        // Постоянная времени инерции, 0 - обычная кривая
+        uint64_t start_ns;
+        uint64_t duration_ns;
+    };
+
     Method active_method;
     int socket_fd;
-    pid_t daemon_pid;
+    int uinput_fd;               // Постоянное устройство для METHOD_DIRECT_UINPUT
+    void* x11_display;           // Display* для METHOD_X11_XTEST (Xlib не тянем в заголовок)
+
+    // Часы кадров плавного скролла: timerfd с абсолютными дедлайнами
+    int frame_timer_fd;
+    uint64_t frame_period_ns;
+    uint64_t frame_deadline_ns;  // Следующий дедлайн
+    AxisAnimation animation_v;
+    AxisAnimation animation_h;
+    ScrollRingHeader* shared_ring; // Кольцо в общей памяти с daemon'ом (если включено)
+    int ring_event_fd;
     std::string socket_path;
-    ScrollConfig config;
+    ScrollConfig config;           // Действующие настройки; при работающем потоке вывода меняет только он
+    ScrollConfig requested_config; // Последний setConfig(), под queue_mutex
+    bool config_changed;           // requested_config еще не перенесен в config
+    bool uinput_write_failed;      // Последняя запись в uinput не удалась (сообщаем один раз на серию)
+
+    // Остатки hi-res единиц до целой ступени колесика
+    int wheel_remainder_v;   // в daemon'е: для дублирования REL_WHEEL
+    int wheel_remainder_h;
+    int precise_remainder_v; // у клиента: для бэкендов без hi-res
+    int precise_remainder_h;
+    int zoom_remainder;      // Ctrl + колесико: REL_WHEEL в daemon'е, кнопки X11 у клиента
+
+    // Поток вывода и ограниченная очередь намерений
+    std::thread output_thread;
+    mutable std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::condition_variable idle_cv;
+    std::condition_variable cancel_cv;   // Будит паузы между шагами при cancelScroll()
+    std::deque<ScrollIntent> intent_queue;
+    bool output_running;
+    bool output_busy;
+    unsigned long dropped_intents;
+    unsigned long cancel_generation;     // Растет при каждом cancelScroll(), под queue_mutex
 
 public:
     ScrollEmulator();
@@ -35,9 +125,10 @@ public:
     bool initialize();
     void cleanup();
 
-    // Настройки
-    void setConfig(const ScrollConfig& cfg) { config = cfg; }
-    ScrollConfig getConfig() const { return config; }
+    // Настройки; при работающем потоке вывода вступают в силу со следующего
+    // намерения, которое он заберет из очереди
+    void setConfig(const ScrollConfig& cfg);
+    ScrollConfig getConfig() const;
 
     // Простые скроллы
     void scrollUp(int steps = 1);
@@ -51,15 +142,47 @@ public:
     void smoothScrollLeft(int distance, int duration_ms = 1000);
     void smoothScrollRight(int distance, int duration_ms = 1000);
 
+    // Плавный скролл на целое число hi-res единиц (1/120 ступени, со знаком):
+    // > 0 - вверх/вправо. Дробное движение жестов копит ScrollAccumulator
+    void smoothScrollVertical(int hires_units, int duration_ms = 1000);
+    void smoothScrollHorizontal(int hires_units, int duration_ms = 1000);
+
+    // Инерционный скролл с начальной скоростью в ступенях в секунду
+    // (> 0 - вверх/вправо), затухает с config.fling_time_constant_ms
+    void flingVertical(float velocity);
+    void flingHorizontal(float velocity);
+
+    // Остановить плавный и инерционный скролл (например, при новом касании);
+    // идущая серия шагов с паузами delay_ms и скролл к краю тоже прерываются,
+    // еще не начатые шаги, страницы и скроллы к краю удаляются из очереди
+    void cancelScroll();
+
+    // Точный скролл на дробное число ступеней (hi-res, 1/120 ступени)
+    // distance > 0 - вверх/вправо, distance < 0 - вниз/влево
+    void scrollPreciseVertical(float distance);
+    void scrollPreciseHorizontal(float distance);
+
+    // Масштаб: Ctrl + hi-res колесико (1/120 ступени, > 0 - приблизить)
+    void zoom(int hires_units);
+
     // Специальные скроллы
     void pageUp();
     void pageDown();
     void scrollToTop();
     void scrollToBottom();
 
+    // Ожидание завершения всех поставленных в очередь скроллов
+    void waitIdle();
+
+    // Постоянный uinput daemon: обслуживает всех клиентов на общем сокете
+    // через одно виртуальное устройство до SIGINT/SIGTERM.
+    // Возвращает false, если daemon уже запущен или сокет недоступен
+    bool serveDaemon();
+
     // Информация
     const char* getMethod();
     bool isAvailable();
+    bool hasHiResOutput() const;
 
 private:
     // Внутренние методы
@@ -67,26 +190,57 @@ private:
     bool tryUinputDaemon();
     bool tryDirectUinput();
 
-    void runUinputDaemon();
+    bool spawnUinputDaemon();
+    bool runUinputDaemon(int idle_timeout_s, int ready_fd);
+    void notifyReady(int ready_fd);
     int openUinput();
     bool setupUinput(int fd);
-    void handleUinputCommand(int uinput_fd, char command, int steps);
-    void handleX11Fallback(char command, int steps);
+    void handleUinputRecord(int device_fd, const ScrollRecord& record);
+    void handleX11Fallback(const ScrollRecord& record);
 
     bool connectToDaemon();
-    void sendDaemonCommand(char command, int steps);
+    void sendDaemonRecords(const ScrollRecord* records, size_t count);
+    void sendDaemonWheel(bool vertical, int hires_value, bool detents);
+    uint16_t detentFlags() const;
+    bool attachSharedRing();
+    void detachSharedRing();
+    bool pushSharedRing(const ScrollRecord& record);
 
+    void executeSteps(bool vertical, bool positive, int steps);
+    unsigned long cancelGeneration() const;
+    bool pauseOutput(int delay_ms, unsigned long generation);
     void executeScroll(bool up, int steps);
     void executeHorizontalScroll(bool right, int steps);
     void executePageScroll(bool up);
+    void executePreciseScroll(bool vertical, int hires_value);
+    void executeZoom(int hires_value);
 
     void executeX11Scroll(bool up, int steps);
     void executeX11HorizontalScroll(bool right, int steps);
     void executeX11PageScroll(bool up);
-    void executeDirectUinput(bool up, int steps);
+    void executeX11Zoom(bool in, int steps);
+    void executeX11Buttons(unsigned int button, int steps);
+    void closeX11Display();
+    void executeDirectUinput(const ScrollRecord& record);
 
     // Плавные скроллы
-    void executeSmoothScroll(bool vertical, bool positive, int distance, int duration_ms);
+    void executeSmoothScroll(bool vertical, bool positive, int hires_distance, int duration_ms);
+    void executeEdgeScroll(bool top);
+    void executeFling(bool vertical, int hires_velocity);
+    void retargetAnimation(bool vertical, long delta, int duration_ms, uint64_t now_ns);
+    void runAnimations();
+    double animationPosition(const AxisAnimation& animation, uint64_t now_ns) const;
+    bool advanceAnimations(uint64_t frame_ns);
+    void startFrameClock(int rate_hz);
+    uint64_t waitFrame();
+    void stopFrameClock();
+
+    // Поток вывода
+    void startOutputThread();
+    void stopOutputThread();
+    void submitIntent(const ScrollIntent& intent);
+    void executeIntent(const ScrollIntent& intent);
+    void outputLoop();
 };
 
 // C API для простой интеграции
@@ -101,6 +255,8 @@ extern "C" {
     // Настройки
     void scroll_emulator_set_delay(void* emulator, int delay_ms);
     void scroll_emulator_set_smooth_steps(void* emulator, int steps);
+    void scroll_emulator_set_coalescing(void* emulator, int coalescing);
+    void scroll_emulator_set_frame_rate(void* emulator, int rate_hz);
     void scroll_emulator_set_verbose(void* emulator, int verbose);
 
     // Простые скроллы
@@ -114,6 +270,20 @@ extern "C" {
     void scroll_emulator_smooth_down(void* emulator, int distance, int duration_ms);
     void scroll_emulator_smooth_left(void* emulator, int distance, int duration_ms);
     void scroll_emulator_smooth_right(void* emulator, int distance, int duration_ms);
+    void scroll_emulator_smooth_vertical(void* emulator, int hires_units, int duration_ms);
+    void scroll_emulator_smooth_horizontal(void* emulator, int hires_units, int duration_ms);
+
+    // Инерционный скролл (ступеней в секунду) и его остановка
+    void scroll_emulator_fling_vertical(void* emulator, float velocity);
+    void scroll_emulator_fling_horizontal(void* emulator, float velocity);
+    void scroll_emulator_cancel(void* emulator);
+
+    // Точный (hi-res) скролл на дробное число ступеней
+    void scroll_emulator_precise_vertical(void* emulator, float distance);
+    void scroll_emulator_precise_horizontal(void* emulator, float distance);
+
+    // Масштаб (Ctrl + колесико, hi-res единицы)
+    void scroll_emulator_zoom(void* emulator, int hires_units);
 
     // Специальные
     void scroll_emulator_page_up(void* emulator);
@@ -121,6 +291,12 @@ extern "C" {
     void scroll_emulator_to_top(void* emulator);
     void scroll_emulator_to_bottom(void* emulator);
 
+    // Ожидание завершения очереди скроллов
+    void scroll_emulator_wait_idle(void* emulator);
+
+    // Постоянный uinput daemon (блокирует до SIGINT/SIGTERM)
+    int scroll_emulator_serve_daemon(void* emulator);
+
     // Информация
     const char* scroll_emulator_get_method(void* emulator);
     int scroll_emulator_is_available(void* emulator);
@@ -0,0 +1,1095 @@
+#include "scroll_engine.h"
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <cmath>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <cstring>  // для strerror
+#include <cerrno>   // для errno
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+    // Часы меток времени libinput
+    uint64_t monotonicMicros() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+    }
+}
+
+ScrollEngine::ScrollEngine()
+    : li_(nullptr), udev_(nullptr), fd_(-1), epoll_fd_(-1), signal_fd_(-1), wake_fd_(-1),
+      control_fd_(-1), queue_fd_(-1), input_stop_fd_(-1), running_(false), verbose_(false),
+      input_pending_(false), merged_input_events_(0), seat_("seat0") {
+    batch_.reserve(MAX_DISPATCH_BATCH);
+    scroll_emulator_.reset(new ScrollEmulator());  // Используем reset вместо make_unique для C++11
+}
+
+ScrollEngine::~ScrollEngine() {
+    cleanup();
+}
+
+void ScrollEngine::addSource(GestureSource* source) {
+    sources_.push_back(std::unique_ptr<GestureSource>(source));
+}
+
+bool ScrollEngine::initialize() {
+    // Маска сигналов наследуется потоком вывода и uinput daemon'ом:
+    // блокируем их до инициализации эмулятора
+    if (!setupSignals()) {
+        return false;
+    }
+
+    // Инициализируем scroll emulator
+    if (!scroll_emulator_->initialize()) {
+        std::cerr << "Ошибка: не удалось инициализировать ScrollEmulator" << std::endl;
+        return false;
+    }
+
+    if (verbose_) {
+        std::cout << "✓ ScrollEmulator инициализирован: " << scroll_emulator_->getMethod() << std::endl;
+    }
+
+    // Настройка интерфейса libinput
+    static const struct libinput_interface interface = {
+        .open_restricted = openRestricted,
+        .close_restricted = closeRestricted,
+    };
+
+    // Явные пути устройств не требуют udev и seat (контейнеры без logind)
+    bool created = device_paths_.empty() ? createUdevContext(&interface) : createPathContext(&interface);
+    if (!created) {
+        return false;
+    }
+
+    fd_ = libinput_get_fd(li_);
+    if (fd_ < 0) {
+        std::cerr << "Ошибка: не удалось получить файловый дескриптор libinput" << std::endl;
+        libinput_unref(li_);
+        li_ = nullptr;
+        if (udev_) {
+            udev_unref(udev_);
+            udev_ = nullptr;
+        }
+        return false;
+    }
+
+    if (verbose_) {
+        std::cout << "✓ libinput инициализирован, источников жестов: " << sources_.size() << std::endl;
+    }
+
+    return setupEventLoop();
+}
+
+bool ScrollEngine::createUdevContext(const struct libinput_interface* interface) {
+    // Создаем udev контекст
+    udev_ = udev_new();
+    if (!udev_) {
+        std::cerr << "Ошибка: не удалось создать udev контекст" << std::endl;
+        return false;
+    }
+
+    // Создаем контекст libinput для udev: один на все источники жестов
+    li_ = libinput_udev_create_context(interface, this, udev_);
+    if (!li_) {
+        std::cerr << "Ошибка: не удалось создать контекст libinput" << std::endl;
+        std::cerr << "Возможные причины:" << std::endl;
+        std::cerr << "  - Нет прав доступа к /dev/input/*" << std::endl;
+        std::cerr << "  - Нужно добавить пользователя в группу input" << std::endl;
+        std::cerr << "  - Или запустить с sudo" << std::endl;
+        udev_unref(udev_);
+        udev_ = nullptr;
+        return false;
+    }
+
+    // Добавляем все устройства из сеанса
+    if (libinput_udev_assign_seat(li_, seat_.c_str()) != 0) {
+        std::cerr << "Ошибка: не удалось назначить seat " << seat_ << std::endl;
+        libinput_unref(li_);
+        li_ = nullptr;
+        udev_unref(udev_);
+        udev_ = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool ScrollEngine::createPathContext(const struct libinput_interface* interface) {
+    li_ = libinput_path_create_context(interface, this);
+    if (!li_) {
+        std::cerr << "Ошибка: не удалось создать контекст libinput" << std::endl;
+        return false;
+    }
+
+    // Перечисления udev нет: libinput открывает только указанные устройства,
+    // DEVICE_ADDED для них проходит тот же отбор, что и при hotplug
+    for (size_t i = 0; i < device_paths_.size(); i++) {
+        if (!libinput_path_add_device(li_, device_paths_[i].c_str())) {
+            std::cerr << "Ошибка: не удалось открыть устройство " << device_paths_[i] << std::endl;
+            std::cerr << "  Проверьте путь и права доступа (группа input или sudo)" << std::endl;
+            libinput_unref(li_);
+            li_ = nullptr;
+            return false;
+        }
+    }
+
+    if (verbose_) {
+        std::cout << "✓ Устройства по путям: " << device_paths_.size() << " (без udev)" << std::endl;
+    }
+
+    return true;
+}
+
+bool ScrollEngine::setupSignals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+
+    // Потоков еще нет, маска процесса и потока совпадают
+    if (pthread_sigmask(SIG_BLOCK, &signals, nullptr) != 0) {
+        std::cerr << "Ошибка: не удалось заблокировать сигналы" << std::endl;
+        return false;
+    }
+
+    signal_fd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd_ < 0) {
+        std::cerr << "Ошибка signalfd: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ScrollEngine::setupEventLoop() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+        std::cerr << "Ошибка: не удалось создать epoll: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // С потоком ввода libinput читает он, а цикл ждет пробуждения от очереди
+    if (input_config_.enabled) {
+        input_queue_.reset(new InputQueue());
+        queue_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        input_stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (queue_fd_ < 0 || input_stop_fd_ < 0) {
+            std::cerr << "Ошибка: не удалось создать eventfd: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    int fds[] = {input_config_.enabled ? queue_fd_ : fd_, signal_fd_, wake_fd_};
+    for (int fd : fds) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            std::cerr << "Ошибка epoll_ctl: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    if (!control_path_.empty() && !openControlSocket()) {
+        return false;
+    }
+    return true;
+}
+
+bool ScrollEngine::openControlSocket() {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (control_path_.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Ошибка: слишком длинный путь управляющего сокета: " << control_path_ << std::endl;
+        return false;
+    }
+    strncpy(addr.sun_path, control_path_.c_str(), sizeof(addr.sun_path) - 1);
+
+    control_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (control_fd_ < 0) {
+        std::cerr << "Ошибка: не удалось создать управляющий сокет: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Сокет, оставшийся от прошлого запуска, заменяем
+    unlink(control_path_.c_str());
+
+    if (bind(control_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(control_fd_, 4) < 0) {
+        std::cerr << "Ошибка: не удалось открыть управляющий сокет " << control_path_
+                  << ": " << strerror(errno) << std::endl;
+        close(control_fd_);
+        control_fd_ = -1;
+        return false;
+    }
+    chmod(control_path_.c_str(), 0600);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = control_fd_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, control_fd_, &ev) < 0) {
+        std::cerr << "Ошибка epoll_ctl: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (verbose_) {
+        std::cout << "✓ Управляющий сокет: " << control_path_ << std::endl;
+    }
+    return true;
+}
+
+void ScrollEngine::cleanup() {
+    running_ = false;
+    stopInputThread();
+
+    if (queue_fd_ >= 0) {
+        close(queue_fd_);
+        queue_fd_ = -1;
+    }
+
+    if (input_stop_fd_ >= 0) {
+        close(input_stop_fd_);
+        input_stop_fd_ = -1;
+    }
+
+    for (size_t i = 0; i < control_clients_.size(); i++) {
+        close(control_clients_[i]);
+    }
+    control_clients_.clear();
+
+    if (control_fd_ >= 0) {
+        close(control_fd_);
+        control_fd_ = -1;
+        unlink(control_path_.c_str());
+    }
+
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+
+    if (wake_fd_ >= 0) {
+        close(wake_fd_);
+        wake_fd_ = -1;
+    }
+
+    // Сигналы остаются заблокированными: пришедший после остановки
+    // сигнал не должен завершать процесс посреди очистки
+    if (signal_fd_ >= 0) {
+        close(signal_fd_);
+        signal_fd_ = -1;
+    }
+
+    if (li_) {
+        libinput_unref(li_);
+        li_ = nullptr;
+    }
+    devices_.clear();
+
+    if (udev_) {
+        udev_unref(udev_);
+        udev_ = nullptr;
+    }
+
+    if (scroll_emulator_) {
+        // Иначе поток вывода доведет инерцию до конца (до ~1.6 с) и только
+        // потом завершится: остановка по сигналу или stop должна быть сразу
+        scroll_emulator_->cancelScroll();
+        scroll_emulator_.reset();
+    }
+}
+
+void ScrollEngine::setScrollConfig(const ScrollEmulator::ScrollConfig& config) {
+    if (scroll_emulator_) {
+        scroll_emulator_->setConfig(config);
+    }
+}
+
+void ScrollEngine::run() {
+    if (!li_ || epoll_fd_ < 0) {
+        std::cerr << "Ошибка: обработчик не инициализирован" << std::endl;
+        return;
+    }
+
+    running_ = true;
+
+    if (input_config_.enabled) {
+        startInputThread();
+    }
+
+    // Без таймаута: просыпаемся только по событию, сигналу или команде.
+    // Если прошлая итерация не забрала все события, только проверяем
+    // сигналы и команды и сразу продолжаем
+    while (running_) {
+        struct epoll_event events[8];
+        int count = epoll_wait(epoll_fd_, events, 8, input_pending_ ? 0 : -1);
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue; // Например, SIGSTOP/SIGCONT
+            }
+            std::cerr << "Ошибка epoll: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == fd_ || fd == queue_fd_) {
+                input_pending_ = true;
+            } else if (fd == signal_fd_) {
+                struct signalfd_siginfo info;
+                while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+                    std::cout << "\nПолучен сигнал " << info.ssi_signo << ", завершаем работу..." << std::endl;
+                    running_ = false;
+                }
+            } else if (fd == wake_fd_) {
+                uint64_t counter;
+                while (read(wake_fd_, &counter, sizeof(counter)) == sizeof(counter)) {}
+            } else if (fd == control_fd_) {
+                acceptControlClients();
+            } else {
+                handleControlClient(fd);
+            }
+        }
+
+        // События - после сигналов и команд: остановка не ждет разбора пачки
+        if (input_pending_ && running_) {
+            if (input_config_.enabled) {
+                drainInputQueue();
+            } else {
+                processEvents();
+            }
+        }
+    }
+
+    stopInputThread();
+
+    if (verbose_) {
+        std::cout << "Диспетчеризация: событий " << stats_.events << ", итераций " << stats_.batches
+                  << ", слито " << stats_.collapsed << ", наибольшая очередь " << stats_.max_backlog
+                  << ", наибольшая задержка " << stats_.max_lag_us / 1000.0 << " мс" << std::endl;
+    }
+}
+
+void ScrollEngine::stop() {
+    running_ = false;
+
+    // Будим epoll_wait, если цикл ждет событий в другом потоке
+    if (wake_fd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd_, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void ScrollEngine::acceptControlClients() {
+    int client_fd;
+    while ((client_fd = accept4(control_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = client_fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            close(client_fd);
+            continue;
+        }
+        control_clients_.push_back(client_fd);
+    }
+}
+
+void ScrollEngine::handleControlClient(int client_fd) {
+    char buffer[128];
+    ssize_t n = read(client_fd, buffer, sizeof(buffer) - 1);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+
+    // Одна команда на соединение: отвечаем и закрываем
+    if (n > 0) {
+        buffer[n] = '\0';
+        std::string command(buffer);
+        size_t end = command.find_last_not_of(" \t\r\n");
+        command.erase(end == std::string::npos ? 0 : end + 1);
+
+        std::string reply = executeControlCommand(command);
+        ssize_t written = write(client_fd, reply.data(), reply.size());
+        (void)written;
+    }
+    closeControlClient(client_fd);
+}
+
+void ScrollEngine::closeControlClient(int client_fd) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client_fd, nullptr);
+    close(client_fd);
+    control_clients_.erase(std::remove(control_clients_.begin(), control_clients_.end(), client_fd),
+                           control_clients_.end());
+}
+
+std::string ScrollEngine::executeControlCommand(const std::string& command) {
+    if (verbose_) {
+        std::cout << "Команда управления: " << command << std::endl;
+    }
+
+    if (command == "stop") {
+        running_ = false;
+        return "ok\n";
+    }
+    if (command == "cancel") {
+        scroll_emulator_->cancelScroll();
+        return "ok\n";
+    }
+    if (command == "status") {
+        std::ostringstream reply;
+        reply << "running " << scroll_emulator_->getMethod()
+              << " events=" << stats_.events << " batches=" << stats_.batches
+              << " collapsed=" << stats_.collapsed << " backlog=" << stats_.last_backlog
+              << " max_backlog=" << stats_.max_backlog << " max_lag_us=" << stats_.max_lag_us
+              << " merged=" << merged_input_events_.load(std::memory_order_relaxed) << "\n";
+        return reply.str();
+    }
+    return "error: неизвестная команда (stop, cancel, status)\n";
+}
+
+void ScrollEngine::processEvents() {
+    libinput_dispatch(li_);
+
+    // Забираем очередь libinput целиком, но не больше пачки за итерацию
+    struct libinput_event *event;
+    InputEvent decoded;
+    size_t fetched = 0;
+    while (fetched < MAX_DISPATCH_BATCH && (event = libinput_get_event(li_))) {
+        fetched++;
+        if (acceptEvent(event) && decodeEvent(event, decoded)) {
+            batch_.push_back(decoded);
+        }
+
+        libinput_event_destroy(event);
+    }
+
+    // Уже прочитанные libinput события fd больше не отмечает - остаток
+    // разбираем на следующей итерации без ожидания
+    input_pending_ = libinput_next_event_type(li_) != LIBINPUT_EVENT_NONE;
+    dispatchBatch();
+}
+
+bool ScrollEngine::acceptEvent(struct libinput_event* event) {
+    struct libinput_device* device = libinput_event_get_device(event);
+
+    switch (libinput_event_get_type(event)) {
+        case LIBINPUT_EVENT_DEVICE_ADDED:
+            handleDeviceAdded(device);
+            return false;
+
+        case LIBINPUT_EVENT_DEVICE_REMOVED:
+            handleDeviceRemoved(device);
+            return false;
+
+        default: {
+            // Устройства без режима send events (клавиатуры) продолжают
+            // присылать события - отсекаем их по кэшу без разбора
+            DeviceInfo* info = static_cast<DeviceInfo*>(libinput_device_get_user_data(device));
+            return !info || info->used;
+        }
+    }
+}
+
+void ScrollEngine::handleDeviceAdded(struct libinput_device* device) {
+    std::unique_ptr<DeviceInfo> info(new DeviceInfo());
+    info->name = libinput_device_get_name(device);
+    info->sysname = libinput_device_get_sysname(device);
+    info->vendor = libinput_device_get_id_vendor(device);
+    info->product = libinput_device_get_id_product(device);
+    info->disabled = false;
+
+    // Возможности проверяются один раз: устройство нужно, если его
+    // события разбирает хотя бы один источник
+    bool capable = false;
+    for (size_t i = 0; i < sources_.size(); i++) {
+        if (libinput_device_has_capability(device, sources_[i]->capability())) {
+            capable = true;
+            break;
+        }
+    }
+    info->used = capable && matchesFilters(*info);
+
+    // Явно указанное устройство без жестов и касаний - скорее ошибка в пути
+    if (!capable && !device_paths_.empty()) {
+        std::cerr << "Предупреждение: " << info->sysname << " (" << info->name
+                  << ") не дает жестов или касаний" << std::endl;
+    }
+
+    // Ненужное устройство libinput закрывает: его события не будят процесс
+    if (!info->used &&
+        (libinput_device_config_send_events_get_modes(device) & LIBINPUT_CONFIG_SEND_EVENTS_DISABLED) &&
+        libinput_device_config_send_events_set_mode(device, LIBINPUT_CONFIG_SEND_EVENTS_DISABLED) ==
+            LIBINPUT_CONFIG_STATUS_SUCCESS) {
+        info->disabled = true;
+    }
+
+    if (verbose_) {
+        char id[16];
+        snprintf(id, sizeof(id), "%04x:%04x", info->vendor, info->product);
+        std::cout << (info->used ? "✓ Устройство: " : "  Пропущено устройство: ") << info->name
+                  << " (" << info->sysname << ", " << id << ")"
+                  << (info->disabled ? ", отключено" : "") << std::endl;
+    }
+
+    libinput_device_set_user_data(device, info.get());
+    devices_.push_back(std::move(info));
+}
+
+void ScrollEngine::handleDeviceRemoved(struct libinput_device* device) {
+    DeviceInfo* info = static_cast<DeviceInfo*>(libinput_device_get_user_data(device));
+    libinput_device_set_user_data(device, nullptr);
+    if (!info) return;
+
+    if (verbose_ && info->used) {
+        std::cout << "Устройство отключено: " << info->name << std::endl;
+    }
+
+    for (size_t i = 0; i < devices_.size(); i++) {
+        if (devices_[i].get() == info) {
+            devices_.erase(devices_.begin() + i);
+            break;
+        }
+    }
+}
+
+bool ScrollEngine::matchesFilters(const DeviceInfo& info) const {
+    if (device_filters_.empty()) {
+        return true;
+    }
+
+    for (size_t i = 0; i < device_filters_.size(); i++) {
+        const DeviceFilter& filter = device_filters_[i];
+        if (filter.by_id) {
+            if (filter.vendor == info.vendor && filter.product == info.product) {
+                return true;
+            }
+        } else if (filter.name == info.name || filter.name == info.sysname) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ScrollEngine::DeviceFilter::parse(const std::string& spec, DeviceFilter& filter) {
+    if (spec.empty()) {
+        std::cerr << "Ошибка: пустое имя устройства" << std::endl;
+        return false;
+    }
+
+    filter = DeviceFilter();
+
+    // vid:pid - ровно 4 + 4 шестнадцатеричные цифры, иначе это имя
+    if (spec.size() == 9 && spec[4] == ':' &&
+        spec.find_first_not_of("0123456789abcdefABCDEF:") == std::string::npos &&
+        spec.find(':', 5) == std::string::npos) {
+        filter.vendor = static_cast<unsigned int>(strtoul(spec.substr(0, 4).c_str(), nullptr, 16));
+        filter.product = static_cast<unsigned int>(strtoul(spec.substr(5).c_str(), nullptr, 16));
+        filter.by_id = true;
+        return true;
+    }
+
+    filter.name = spec;
+    return true;
+}
+
+bool ScrollEngine::decodeEvent(struct libinput_event* event, InputEvent& decoded) {
+    decoded = InputEvent();
+    decoded.type = libinput_event_get_type(event);
+
+    switch (decoded.type) {
+        case LIBINPUT_EVENT_TOUCH_DOWN:
+        case LIBINPUT_EVENT_TOUCH_MOTION: {
+            struct libinput_event_touch* touch = libinput_event_get_touch_event(event);
+            decoded.slot = libinput_event_touch_get_slot(touch);
+            decoded.x = libinput_event_touch_get_x(touch);
+            decoded.y = libinput_event_touch_get_y(touch);
+            decoded.time_us = libinput_event_touch_get_time_usec(touch);
+            return true;
+        }
+
+        case LIBINPUT_EVENT_TOUCH_UP:
+        case LIBINPUT_EVENT_TOUCH_CANCEL: {
+            // Координаты у отрыва не определены
+            struct libinput_event_touch* touch = libinput_event_get_touch_event(event);
+            decoded.slot = libinput_event_touch_get_slot(touch);
+            decoded.time_us = libinput_event_touch_get_time_usec(touch);
+            return true;
+        }
+
+        case LIBINPUT_EVENT_TOUCH_FRAME:
+            return true;
+
+        case LIBINPUT_EVENT_GESTURE_SWIPE_BEGIN:
+        case LIBINPUT_EVENT_GESTURE_SWIPE_UPDATE:
+        case LIBINPUT_EVENT_GESTURE_SWIPE_END:
+        case LIBINPUT_EVENT_GESTURE_PINCH_BEGIN:
+        case LIBINPUT_EVENT_GESTURE_PINCH_UPDATE:
+        case LIBINPUT_EVENT_GESTURE_PINCH_END:
+#ifdef HAVE_LIBINPUT_HOLD
+        case LIBINPUT_EVENT_GESTURE_HOLD_BEGIN:
+#endif
+        {
+            struct libinput_event_gesture* gesture = libinput_event_get_gesture_event(event);
+            decoded.fingers = libinput_event_gesture_get_finger_count(gesture);
+            decoded.time_us = libinput_event_gesture_get_time_usec(gesture);
+
+            if (decoded.type == LIBINPUT_EVENT_GESTURE_SWIPE_UPDATE ||
+                decoded.type == LIBINPUT_EVENT_GESTURE_PINCH_UPDATE) {
+                decoded.dx = libinput_event_gesture_get_dx_unaccelerated(gesture);
+                decoded.dy = libinput_event_gesture_get_dy_unaccelerated(gesture);
+            }
+            if (decoded.type == LIBINPUT_EVENT_GESTURE_PINCH_UPDATE) {
+                decoded.scale = libinput_event_gesture_get_scale(gesture);
+            }
+            if (decoded.type == LIBINPUT_EVENT_GESTURE_SWIPE_END ||
+                decoded.type == LIBINPUT_EVENT_GESTURE_PINCH_END) {
+                decoded.cancelled = libinput_event_gesture_get_cancelled(gesture) != 0;
+            }
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+void ScrollEngine::dispatchBatch() {
+    if (batch_.empty()) return;
+
+    stats_.batches++;
+    stats_.events += batch_.size();
+    stats_.last_backlog = batch_.size();
+    stats_.max_backlog = std::max(stats_.max_backlog, batch_.size());
+
+    // Задержка самого старого события пачки (у кадров касаний метки нет)
+    for (size_t i = 0; i < batch_.size(); i++) {
+        if (batch_[i].time_us == 0) continue;
+        uint64_t now_us = monotonicMicros();
+        if (now_us > batch_[i].time_us) {
+            stats_.max_lag_us = std::max(stats_.max_lag_us, now_us - batch_[i].time_us);
+        }
+        break;
+    }
+
+    if (batch_.size() > 1) {
+        stats_.collapsed += collapseBatch();
+    }
+
+    for (size_t i = 0; i < batch_.size(); i++) {
+        dispatchEvent(batch_[i]);
+    }
+    batch_.clear();
+}
+
+size_t ScrollEngine::collapseBatch() {
+    // Сжатие на месте: out - конец уже сжатой части
+    size_t out = 0;
+    for (size_t i = 0; i < batch_.size(); i++) {
+        const InputEvent& event = batch_[i];
+
+        if (out > 0) {
+            InputEvent& prev = batch_[out - 1];
+
+            // Обновления swipe/pinch: дельты складываются, масштаб pinch
+            // и метка времени берутся последние
+            if ((event.type == LIBINPUT_EVENT_GESTURE_SWIPE_UPDATE ||
+                 event.type == LIBINPUT_EVENT_GESTURE_PINCH_UPDATE) &&
+                prev.type == event.type && prev.fingers == event.fingers) {
+                prev.dx += event.dx;
+                prev.dy += event.dy;
+                prev.scale = event.scale;
+                prev.time_us = event.time_us;
+                continue;
+            }
+
+            // Касания: координаты абсолютные, поэтому промежуточный кадр
+            // перед новым движением не нужен, а из движений одного слота
+            // подряд важно только последнее
+            if (event.type == LIBINPUT_EVENT_TOUCH_MOTION &&
+                (prev.type == LIBINPUT_EVENT_TOUCH_FRAME ||
+                 (prev.type == LIBINPUT_EVENT_TOUCH_MOTION && prev.slot == event.slot))) {
+                prev = event;
+                continue;
+            }
+        }
+
+        batch_[out++] = event;
+    }
+
+    size_t collapsed = batch_.size() - out;
+    batch_.resize(out);
+    return collapsed;
+}
+
+void ScrollEngine::dispatchEvent(const InputEvent& event) {
+    for (size_t i = 0; i < sources_.size(); i++) {
+        if (sources_[i]->handleEvent(event)) {
+            break;
+        }
+    }
+}
+
+void ScrollEngine::startInputThread() {
+    if (input_thread_.joinable()) return;
+
+    // Поток наследует маску сигналов: их по-прежнему читает signalfd цикла
+    input_thread_ = std::thread(&ScrollEngine::inputLoop, this);
+    applyInputScheduling();
+}
+
+void ScrollEngine::stopInputThread() {
+    if (!input_thread_.joinable()) return;
+
+    uint64_t one = 1;
+    ssize_t written = write(input_stop_fd_, &one, sizeof(one));
+    (void)written;
+    input_thread_.join();
+
+    input_backlog_.clear();
+
+    uint64_t merged = merged_input_events_.load(std::memory_order_relaxed);
+    if (verbose_ && merged > 0) {
+        std::cout << "Слито событий ввода при переполнении очереди: " << merged << std::endl;
+    }
+}
+
+void ScrollEngine::applyInputScheduling() {
+    pthread_t handle = input_thread_.native_handle();
+
+    if (input_config_.priority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = input_config_.priority;
+        int err = pthread_setschedparam(handle, input_config_.policy, &param);
+        if (err != 0) {
+            std::cerr << "Предупреждение: приоритет реального времени недоступен (" << strerror(err)
+                      << "), поток ввода работает с обычным приоритетом" << std::endl;
+            if (err == EPERM) {
+                std::cerr << "  Нужна CAP_SYS_NICE или RLIMIT_RTPRIO (limits.conf: rtprio)" << std::endl;
+            }
+        } else if (verbose_) {
+            std::cout << "✓ Поток ввода: " << (input_config_.policy == SCHED_RR ? "SCHED_RR" : "SCHED_FIFO")
+                      << ", приоритет " << input_config_.priority << std::endl;
+        }
+    }
+
+    if (input_config_.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(input_config_.cpu, &cpus);
+        int err = pthread_setaffinity_np(handle, sizeof(cpus), &cpus);
+        if (err != 0) {
+            std::cerr << "Предупреждение: не удалось привязать поток ввода к CPU " << input_config_.cpu
+                      << ": " << strerror(err) << std::endl;
+        } else if (verbose_) {
+            std::cout << "✓ Поток ввода привязан к CPU " << input_config_.cpu << std::endl;
+        }
+    }
+}
+
+void ScrollEngine::inputLoop() {
+    struct pollfd fds[2];
+    fds[0].fd = fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = input_stop_fd_;
+    fds[1].events = POLLIN;
+
+    while (true) {
+        // Пока есть отложенные события, проверяем очередь каждую миллисекунду
+        int ret = poll(fds, 2, input_backlog_.empty() ? -1 : 1);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        flushInputBacklog();
+        if (ret == 0) continue;
+        if (fds[1].revents & POLLIN) break;
+        if (fds[0].revents & POLLIN) {
+            readInputEvents();
+        }
+    }
+}
+
+void ScrollEngine::readInputEvents() {
+    libinput_dispatch(li_);
+
+    // В потоке ввода нет работы с эмулятором: только чтение устройств,
+    // учет их подключения и копирование полей события
+    struct libinput_event *event;
+    InputEvent decoded;
+    while ((event = libinput_get_event(li_))) {
+        if (acceptEvent(event) && decodeEvent(event, decoded)) {
+            pushInputEvent(decoded);
+        }
+        libinput_event_destroy(event);
+    }
+}
+
+void ScrollEngine::pushInputEvent(const InputEvent& event) {
+    // Поток ввода не ждет цикл жестов: при полной очереди событие уходит
+    // в хвост, порядок сохраняется
+    flushInputBacklog();
+    if (!input_backlog_.empty() || !input_queue_->push(event)) {
+        appendInputBacklog(event);
+        return;
+    }
+
+    // Системный вызов только если цикл жестов уснул на пустой очереди
+    if (input_queue_->takeWakeup()) {
+        uint64_t one = 1;
+        if (write(queue_fd_, &one, sizeof(one)) < 0) {
+            // Счетчик eventfd уже ненулевой
+        }
+    }
+}
+
+void ScrollEngine::flushInputBacklog() {
+    bool pushed = false;
+    while (!input_backlog_.empty() && input_queue_->push(input_backlog_.front())) {
+        input_backlog_.pop_front();
+        pushed = true;
+    }
+
+    if (pushed && input_queue_->takeWakeup()) {
+        uint64_t one = 1;
+        if (write(queue_fd_, &one, sizeof(one)) < 0) {
+            // Счетчик eventfd уже ненулевой
+        }
+    }
+}
+
+void ScrollEngine::appendInputBacklog(const InputEvent& event) {
+    if (!input_backlog_.empty()) {
+        InputEvent& last = input_backlog_.back();
+
+        // Обновления одного жеста: дельты складываются, масштаб берется последний
+        if ((event.type == LIBINPUT_EVENT_GESTURE_SWIPE_UPDATE ||
+             event.type == LIBINPUT_EVENT_GESTURE_PINCH_UPDATE) &&
+            last.type == event.type && last.fingers == event.fingers) {
+            last.dx += event.dx;
+            last.dy += event.dy;
+            last.scale = event.scale;
+            last.time_us = event.time_us;
+            merged_input_events_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // Пустые кадры подряд ничего не добавляют к состоянию касаний
+        if (event.type == LIBINPUT_EVENT_TOUCH_FRAME && last.type == LIBINPUT_EVENT_TOUCH_FRAME) {
+            last.time_us = event.time_us;
+            merged_input_events_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // Движение касания заменяет ждущее движение того же слота, если
+        // между ними только движения и кадры (без down/up)
+        if (event.type == LIBINPUT_EVENT_TOUCH_MOTION) {
+            for (auto it = input_backlog_.rbegin(); it != input_backlog_.rend(); ++it) {
+                if (it->type != LIBINPUT_EVENT_TOUCH_MOTION && it->type != LIBINPUT_EVENT_TOUCH_FRAME) break;
+                if (it->type == LIBINPUT_EVENT_TOUCH_MOTION && it->slot == event.slot) {
+                    *it = event;
+                    merged_input_events_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        }
+    }
+
+    // Начало, конец, down/up и все прочее доставляются всегда
+    input_backlog_.push_back(event);
+}
+
+void ScrollEngine::drainInputQueue() {
+    uint64_t counter;
+    while (read(queue_fd_, &counter, sizeof(counter)) == sizeof(counter)) {}
+
+    InputEvent event;
+    while (batch_.size() < MAX_DISPATCH_BATCH && input_queue_->pop(event)) {
+        batch_.push_back(event);
+    }
+
+    // Неполная пачка - очередь пуста: перед уходом в epoll_wait перепроверяем
+    // ее, чтобы не потерять событие, положенное потоком ввода в этот момент
+    input_pending_ = batch_.size() == MAX_DISPATCH_BATCH || !input_queue_->prepareWait();
+    dispatchBatch();
+}
+
+bool ScrollEngine::tryActivate(MotionState& state, const MotionProfile& profile, uint64_t time_us) {
+    if (state.active) {
+        return false;
+    }
+
+    // Проверяем, достигли ли мы порога для начала жеста
+    double total_movement = std::sqrt(
+        state.total_delta_x * state.total_delta_x +
+        state.total_delta_y * state.total_delta_y
+    );
+    if (total_movement <= profile.start_threshold) {
+        return false;
+    }
+
+    state.active = true;
+    state.last_scroll_time_us = time_us;
+
+    GestureDirection dir = calculateDirection(state.total_delta_x, state.total_delta_y);
+    if (verbose_) {
+        std::cout << profile.gesture_label << " активирован, направление: " << static_cast<int>(dir) << std::endl;
+    }
+    performDiscreteAction(state.action, dir);
+    return true;
+}
+
+bool ScrollEngine::shouldScroll(const MotionState& state, const MotionProfile& profile, uint64_t time_us) const {
+    uint64_t time_since_last = (time_us - state.last_scroll_time_us) / 1000;
+
+    return time_since_last >= static_cast<uint64_t>(profile.min_scroll_interval_ms);
+}
+
+void ScrollEngine::performSmoothScroll(MotionState& state, const MotionProfile& profile,
+                                       double delta_x, double delta_y, uint64_t time_us) {
+    // Определяем основное направление движения
+    double abs_x = std::abs(delta_x);
+    double abs_y = std::abs(delta_y);
+
+    // Вычисляем временную разность для адаптации скорости
+    // по меткам времени событий: задержка обработки скорость не искажает
+    double time_diff = (time_us - state.last_scroll_time_us) / 1000.0;
+
+    if (time_diff < 1.0) time_diff = 1.0; // Избегаем деления на ноль
+
+    // Вертикальная прокрутка (приоритет)
+    if (abs_y > profile.scroll_threshold) {
+        double intensity = calculateScrollIntensity(profile, abs_y, time_diff);
+
+        // Движение вверх = скролл вверх; выводим только накопившиеся целые hi-res единицы
+        double scroll = delta_y < 0 ? intensity : -intensity;
+        // При действии FLING движение только копится для оценки скорости
+        state.velocity.addSample(time_us, 0.0, scroll);
+        int units = state.scroll_y.add(scroll);
+        if (units != 0 && state.action == GestureAction::SCROLL) {
+            scroll_emulator_->smoothScrollVertical(units, profile.smooth_duration_ms);
+            if (verbose_) {
+                std::cout << (units > 0 ? "↑ " : "↓ ") << profile.scroll_label
+                          << (units > 0 ? " вверх: " : " вниз: ")
+                          << std::abs(units) / 120.0 << std::endl;
+            }
+        }
+    }
+    // Горизонтальная прокрутка (если вертикальное движение меньше)
+    else if (abs_x > profile.scroll_threshold) {
+        double intensity = calculateScrollIntensity(profile, abs_x, time_diff);
+
+        // Движение вправо = скролл вправо
+        double scroll = delta_x > 0 ? intensity : -intensity;
+        state.velocity.addSample(time_us, scroll, 0.0);
+        int units = state.scroll_x.add(scroll);
+        if (units != 0 && state.action == GestureAction::SCROLL) {
+            scroll_emulator_->smoothScrollHorizontal(units, profile.smooth_duration_ms);
+            if (verbose_) {
+                std::cout << (units > 0 ? "→ " : "← ") << profile.scroll_label
+                          << (units > 0 ? " вправо: " : " влево: ")
+                          << std::abs(units) / 120.0 << std::endl;
+            }
+        }
+    }
+}
+
+void ScrollEngine::startFling(MotionState& state, uint64_t time_us) {
+    double velocity_x = 0.0;
+    double velocity_y = 0.0;
+    if (!state.velocity.velocity(time_us, MotionState::FLING_WINDOW_US, velocity_x, velocity_y)) {
+        return;
+    }
+
+    // Инерция по основной оси жеста; затухание считает поток вывода эмулятора
+    if (std::abs(velocity_y) >= std::abs(velocity_x)) {
+        if (std::abs(velocity_y) < MotionState::MIN_FLING_VELOCITY) return;
+        scroll_emulator_->flingVertical(static_cast<float>(velocity_y));
+    } else {
+        if (std::abs(velocity_x) < MotionState::MIN_FLING_VELOCITY) return;
+        scroll_emulator_->flingHorizontal(static_cast<float>(velocity_x));
+    }
+
+    if (verbose_) {
+        std::cout << "Инерция: " << velocity_x << ", " << velocity_y << " ступеней/с" << std::endl;
+    }
+}
+
+void ScrollEngine::performDiscreteAction(GestureAction action, GestureDirection direction) {
+    if (action == GestureAction::PAGE) {
+        if (direction == GestureDirection::UP) {
+            scroll_emulator_->pageUp();
+        } else if (direction == GestureDirection::DOWN) {
+            scroll_emulator_->pageDown();
+        }
+    } else if (action == GestureAction::EDGE) {
+        if (direction == GestureDirection::UP) {
+            scroll_emulator_->scrollToTop();
+        } else if (direction == GestureDirection::DOWN) {
+            scroll_emulator_->scrollToBottom();
+        }
+    }
+}
+
+GestureDirection ScrollEngine::calculateDirection(double delta_x, double delta_y) {
+    double abs_x = std::abs(delta_x);
+    double abs_y = std::abs(delta_y);
+
+    if (abs_x > abs_y) {
+        return (delta_x > 0) ? GestureDirection::RIGHT : GestureDirection::LEFT;
+    } else {
+        return (delta_y > 0) ? GestureDirection::DOWN : GestureDirection::UP;
+    }
+}
+
+double ScrollEngine::calculateScrollIntensity(const MotionProfile& profile, double delta, double time_diff_ms) const {
+    // Базовая интенсивность на основе размера движения
+    double base_intensity = std::abs(delta) / profile.intensity_divisor;
+
+    // Корректировка на основе времени (чем быстрее, тем интенсивнее)
+    double time_factor = profile.time_scale_ms / std::max(1.0, time_diff_ms);
+
+    // Комбинируем факторы
+    double intensity = base_intensity * time_factor;
+
+    // Ограничиваем только сверху: медленное движение дает долю ступени,
+    // которая копится в ScrollAccumulator, а не округляется до целой
+    return std::min(profile.max_intensity, intensity);
+}
+
+int ScrollEngine::openRestricted(const char* path, int flags, void* user_data) {
+    int fd = open(path, flags);
+    if (fd < 0) {
+        ScrollEngine* engine = static_cast<ScrollEngine*>(user_data);
+        if (engine && engine->verbose_) {
+            std::cerr << "Не удалось открыть " << path << ": " << strerror(errno) << std::endl;
+        }
+    }
+    return fd;
+}
+
+void ScrollEngine::closeRestricted(int fd, void* user_data) {
+    (void)user_data;  // Подавляем предупреждение о неиспользованном параметре
+    close(fd);
+}
@@ -0,0 +1,516 @@
+#ifndef SCROLL_ENGINE_H
+#define SCROLL_ENGINE_H
+
+#include <libinput.h>
+#include <libudev.h>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "scroll_emulator.h"
+#include "scroll_motion.h"
+#include "gesture_bindings.h"
+
+/**
+ * Направления жестов
+ */
+enum class GestureDirection {
+    UNKNOWN = 0,
+    UP = 1,
+    DOWN = 2,
+    LEFT = 3,
+    RIGHT = 4
+};
+
+/**
+ * Параметры конвейера движения для одного источника жестов.
+ * Тачпад и сенсорный экран отличаются только ими, а не кодом
+ */
+struct MotionProfile {
+    double start_threshold;     // Минимальное движение для начала жеста
+    double scroll_threshold;    // Минимальное движение для продолжения скролла
+    int min_scroll_interval_ms; // Минимальный интервал между скроллами
+    double intensity_divisor;   // Движение, дающее единицу базовой интенсивности
+    double time_scale_ms;       // Интервал, на котором скорость не меняет интенсивность
+    double max_intensity;       // Ограничение интенсивности сверху (ступеней за обновление)
+    int smooth_duration_ms;     // Длительность анимации одного обновления
+    const char* gesture_label;  // Подробный вывод: "Жест активирован"
+    const char* scroll_label;   // Подробный вывод: "Скролл вниз"
+};
+
+/**
+ * Общее состояние движения жеста: активация, дробный скролл и скорость
+ */
+struct MotionState {
+    bool active = false;
+    GestureAction action = GestureAction::NONE; // Действие, назначенное жесту
+
+    // Накопленные дельты для определения направления
+    double total_delta_x = 0.0;
+    double total_delta_y = 0.0;
+
+    // Дробный скролл, еще не выведенный эмулятору
+    ScrollAccumulator scroll_x;
+    ScrollAccumulator scroll_y;
+
+    // Выведенный скролл с метками времени libinput для оценки скорости инерции
+    VelocityEstimator velocity;
+
+    uint64_t last_scroll_time_us = 0; // Метка времени libinput последнего скролла
+    std::chrono::steady_clock::time_point gesture_start_time;
+
+    static constexpr uint64_t FLING_WINDOW_US = 100000; // Окно оценки скорости перед отрывом пальцев
+    static constexpr double MIN_FLING_VELOCITY = 5.0; // Минимальная скорость для инерции (ступеней/с)
+
+    void resetMotion() {
+        active = false;
+        action = GestureAction::NONE;
+        total_delta_x = 0.0;
+        total_delta_y = 0.0;
+        scroll_x.reset();
+        scroll_y.reset();
+        velocity.reset();
+    }
+};
+
+/**
+ * Декодированное событие libinput: все, что нужно источникам жестов.
+ * Копируется между потоками, в отличие от libinput_event, который
+ * принадлежит контексту libinput и живет только в его потоке
+ */
+struct InputEvent {
+    enum libinput_event_type type = LIBINPUT_EVENT_NONE;
+    uint64_t time_us = 0;     // Метка времени libinput
+    int32_t slot = 0;         // Касание: слот
+    double x = 0.0;           // Касание: координаты в мм
+    double y = 0.0;
+    double dx = 0.0;          // Жест: неускоренные дельты
+    double dy = 0.0;
+    double scale = 1.0;       // Pinch: масштаб относительно начала жеста
+    int fingers = 0;          // Жест: число пальцев
+    bool cancelled = false;   // Конец жеста: жест отменен
+};
+
+/**
+ * Очередь декодированных событий от потока ввода к циклу жестов: один
+ * производитель, один потребитель, без блокировок. Протокол как у кольца
+ * uinput daemon'а (scroll_protocol.h): свободно растущие head/tail, в
+ * eventfd производитель пишет, только если потребитель уснул
+ */
+class InputQueue {
+public:
+    static const uint32_t CAPACITY = 1024; // Степень двойки, ~1 с касаний при 1 кГц
+
+    InputQueue() : head_(0), tail_(0), consumer_waiting_(1) {}
+
+    /**
+     * Производитель: положить событие; false - очередь заполнена
+     */
+    bool push(const InputEvent& event) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= CAPACITY) {
+            return false;
+        }
+        events_[head & (CAPACITY - 1)] = event;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Производитель: нужно ли будить потребителя (он уснул на пустой очереди)
+     */
+    bool takeWakeup() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return consumer_waiting_.load(std::memory_order_relaxed) &&
+               consumer_waiting_.exchange(0, std::memory_order_acq_rel);
+    }
+
+    /**
+     * Потребитель: забрать событие; false - очередь пуста
+     */
+    bool pop(InputEvent& event) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        event = events_[tail & (CAPACITY - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Потребитель: уходим в ожидание; false - очередь уже не пуста,
+     * ждать нельзя (событие положено между pop() и этим вызовом)
+     */
+    bool prepareWait() {
+        consumer_waiting_.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        consumer_waiting_.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+private:
+    std::atomic<uint32_t> head_;             // Пишет поток ввода
+    char pad_head_[60];
+    std::atomic<uint32_t> tail_;             // Пишет цикл жестов
+    char pad_tail_[60];
+    std::atomic<uint32_t> consumer_waiting_; // 1 - цикл жестов ждет пробуждения через eventfd
+    char pad_state_[60];
+    InputEvent events_[CAPACITY];
+};
+
+/**
+ * Источник жестов: разбирает свои события и передает движение
+ * в общий конвейер ScrollEngine
+ */
+class GestureSource {
+public:
+    virtual ~GestureSource() {}
+
+    /**
+     * Обработка события; false - событие не относится к источнику
+     */
+    virtual bool handleEvent(const InputEvent& event) = 0;
+
+    /**
+     * Возможность устройства, события которого нужны источнику
+     */
+    virtual enum libinput_device_capability capability() const = 0;
+};
+
+/**
+ * Движок прокрутки: один контекст libinput, один ScrollEmulator и общий
+ * конвейер движения (активация, темп, интенсивность, инерция) для всех
+ * подключенных источников. Тачпад и сенсорный экран обслуживаются одним
+ * процессом, одним udev монитором и одним uinput daemon'ом.
+ *
+ * Цикл событий - epoll без таймаута: libinput, signalfd (SIGINT, SIGTERM,
+ * SIGHUP), eventfd пробуждения для stop() и управляющий сокет. В простое
+ * процесс не просыпается вовсе
+ */
+class ScrollEngine {
+public:
+    /**
+     * Отдельный поток ввода: libinput dispatch и декодирование событий,
+     * дальше события идут в цикл жестов через InputQueue
+     */
+    struct InputThreadConfig {
+        bool enabled = false;
+        int priority = 0;          // 0 - обычный планировщик, 1-99 - реального времени
+        int policy = SCHED_FIFO;   // SCHED_FIFO или SCHED_RR
+        int cpu = -1;              // Привязка к CPU, -1 - без привязки
+    };
+
+    /**
+     * Счетчики диспетчеризации событий (команда status управляющего сокета)
+     */
+    struct DispatchStats {
+        uint64_t batches = 0;       // Итераций диспетчеризации
+        uint64_t events = 0;        // Событий получено
+        uint64_t collapsed = 0;     // Событий слито с соседними при отставании
+        size_t last_backlog = 0;    // Событий в очереди на последней итерации
+        size_t max_backlog = 0;     // Наибольшая очередь за время работы
+        uint64_t max_lag_us = 0;    // Наибольшая задержка от метки libinput до обработки
+    };
+
+    /**
+     * Наибольшее число событий, обрабатываемых за одну итерацию цикла;
+     * остаток - на следующей, после сигналов и команд
+     */
+    static const size_t MAX_DISPATCH_BATCH = 256;
+
+    /**
+     * Фильтр устройств: имя libinput ("ELAN Touchscreen"), системное имя
+     * (event5) или vid:pid в шестнадцатеричном виде (04f3:2234)
+     */
+    struct DeviceFilter {
+        std::string name;
+        unsigned int vendor = 0;
+        unsigned int product = 0;
+        bool by_id = false;
+
+        static bool parse(const std::string& spec, DeviceFilter& filter);
+    };
+
+    ScrollEngine();
+    ~ScrollEngine();
+
+    /**
+     * Подключить источник жестов (движок становится его владельцем)
+     */
+    void addSource(GestureSource* source);
+
+    /**
+     * Инициализация libinput и scroll emulator
+     */
+    bool initialize();
+
+    /**
+     * Очистка ресурсов
+     */
+    void cleanup();
+
+    /**
+     * Основной цикл обработки событий (до сигнала, команды stop или stop())
+     */
+    void run();
+
+    /**
+     * Остановка обработки; безопасно вызывать из другого потока
+     */
+    void stop();
+
+    /**
+     * Unix сокет для команд (stop, cancel, status); задается до initialize()
+     */
+    void setControlSocket(const std::string& path) { control_path_ = path; }
+
+    /**
+     * Поток ввода с приоритетом реального времени; задается до initialize()
+     */
+    void setInputThread(const InputThreadConfig& config) { input_config_ = config; }
+
+    /**
+     * Разрешенные устройства; пустой список - все устройства с жестами
+     * или касаниями. Задается до initialize()
+     */
+    void setDeviceFilters(const std::vector<DeviceFilter>& filters) { device_filters_ = filters; }
+
+    /**
+     * Seat для udev (по умолчанию seat0); задается до initialize()
+     */
+    void setSeat(const std::string& seat) { seat_ = seat; }
+
+    /**
+     * Пути /dev/input/eventN: libinput открывает только их, без udev и seat.
+     * Пустой список - устройства seat через udev. Задается до initialize()
+     */
+    void setDevicePaths(const std::vector<std::string>& paths) { device_paths_ = paths; }
+
+    /**
+     * Настройки прокрутки
+     */
+    void setScrollConfig(const ScrollEmulator::ScrollConfig& config);
+
+    /**
+     * Включить/отключить подробный вывод
+     */
+    void setVerbose(bool verbose) { verbose_ = verbose; }
+    bool verbose() const { return verbose_; }
+
+    /**
+     * Назначения жестов (число пальцев -> действие)
+     */
+    void setBindings(const GestureBindings& bindings) { bindings_ = bindings; }
+    const GestureBindings& bindings() const { return bindings_; }
+
+    ScrollEmulator& emulator() { return *scroll_emulator_; }
+
+    const DispatchStats& dispatchStats() const { return stats_; }
+
+    /**
+     * Проверка порога начала жеста по накопленному движению; при активации
+     * выполняет однократное действие (страница, край документа)
+     */
+    bool tryActivate(MotionState& state, const MotionProfile& profile, uint64_t time_us);
+
+    /**
+     * Проверка, прошло ли достаточно времени для следующего скролла (по меткам libinput)
+     */
+    bool shouldScroll(const MotionState& state, const MotionProfile& profile, uint64_t time_us) const;
+
+    /**
+     * Выполнение плавной прокрутки на основе дельты движения
+     */
+    void performSmoothScroll(MotionState& state, const MotionProfile& profile,
+                             double delta_x, double delta_y, uint64_t time_us);
+
+    /**
+     * Запуск инерционного скролла со скоростью жеста в момент отрыва пальцев
+     */
+    void startFling(MotionState& state, uint64_t time_us);
+
+    /**
+     * Однократное действие (страница, край документа) по направлению жеста
+     */
+    void performDiscreteAction(GestureAction action, GestureDirection direction);
+
+    /**
+     * Определение направления жеста
+     */
+    static GestureDirection calculateDirection(double delta_x, double delta_y);
+
+    /**
+     * Действие выводит движение пальцев непрерывно (scroll, fling)
+     */
+    static bool isContinuous(GestureAction action) {
+        return action == GestureAction::SCROLL || action == GestureAction::FLING;
+    }
+
+private:
+    struct libinput* li_;
+    struct udev* udev_;
+    int fd_;
+    int epoll_fd_;
+    int signal_fd_;   // SIGINT, SIGTERM, SIGHUP
+    int wake_fd_;     // eventfd: stop() из другого потока
+    int control_fd_;  // Слушающий управляющий сокет
+    int queue_fd_;    // eventfd: в InputQueue появились события
+    int input_stop_fd_; // eventfd: остановка потока ввода
+    std::atomic<bool> running_;
+    bool verbose_;
+    bool input_pending_; // В libinput или InputQueue остались необработанные события
+
+    std::string control_path_;
+    std::vector<int> control_clients_;
+
+    std::unique_ptr<ScrollEmulator> scroll_emulator_;
+    GestureBindings bindings_;
+    std::vector<std::unique_ptr<GestureSource>> sources_;
+
+    InputThreadConfig input_config_;
+    std::thread input_thread_;
+    std::unique_ptr<InputQueue> input_queue_;
+    std::atomic<uint64_t> merged_input_events_; // Пишет поток ввода, читает команда status
+    std::deque<InputEvent> input_backlog_;      // Только поток ввода: не поместилось в InputQueue
+
+    std::vector<InputEvent> batch_;
+    DispatchStats stats_;
+
+    /**
+     * Устройство, проверенное один раз при подключении; указатель хранится
+     * в user_data устройства libinput
+     */
+    struct DeviceInfo {
+        std::string name;
+        std::string sysname;
+        unsigned int vendor;
+        unsigned int product;
+        bool used;       // Нужно хотя бы одному источнику и прошло фильтр
+        bool disabled;   // События отключены через send events
+    };
+
+    std::vector<DeviceFilter> device_filters_;
+    std::vector<std::unique_ptr<DeviceInfo>> devices_; // Только поток libinput
+
+    std::string seat_;
+    std::vector<std::string> device_paths_;
+
+    /**
+     * Контекст libinput: все устройства seat через udev или только
+     * устройства из device_paths_
+     */
+    bool createUdevContext(const struct libinput_interface* interface);
+    bool createPathContext(const struct libinput_interface* interface);
+
+    /**
+     * Обработка событий libinput в потоке цикла жестов (без потока ввода)
+     */
+    void processEvents();
+
+    /**
+     * Подключение и отключение устройств, отсев событий неиспользуемых
+     * устройств; false - событие дальше не передается
+     */
+    bool acceptEvent(struct libinput_event* event);
+    void handleDeviceAdded(struct libinput_device* device);
+    void handleDeviceRemoved(struct libinput_device* device);
+    bool matchesFilters(const DeviceInfo& info) const;
+
+    /**
+     * Декодирование события libinput; false - событие не нужно источникам
+     */
+    static bool decodeEvent(struct libinput_event* event, InputEvent& decoded);
+
+    /**
+     * Каждое событие получает первый источник, который его принял
+     */
+    void dispatchEvent(const InputEvent& event);
+
+    /**
+     * Обработка накопленной пачки событий: учет отставания, слияние
+     * устаревших обновлений и передача источникам
+     */
+    void dispatchBatch();
+
+    /**
+     * Слияние подряд идущих обновлений одного жеста. Несколько обновлений
+     * в одной пачке означают, что цикл отстал: вместо повтора устаревших
+     * шагов жест получает одно обновление на сумму
+     */
+    size_t collapseBatch();
+
+    /**
+     * Поток ввода: ждет libinput и кладет декодированные события в очередь
+     */
+    void startInputThread();
+    void stopInputThread();
+    void inputLoop();
+    void readInputEvents();
+    void pushInputEvent(const InputEvent& event);
+
+    /**
+     * Переполнение InputQueue: события ждут в input_backlog_ и досылаются
+     * по мере освобождения очереди. Начало, конец, касания и кадры никогда
+     * не теряются; обновления жестов и движения касаний сливаются с уже
+     * ждущими, чтобы хвост не рос без ограничений
+     */
+    void flushInputBacklog();
+    void appendInputBacklog(const InputEvent& event);
+
+    /**
+     * Приоритет и привязка к CPU потока ввода; без CAP_SYS_NICE поток
+     * остается с обычным приоритетом
+     */
+    void applyInputScheduling();
+
+    /**
+     * Цикл жестов: все события из очереди потока ввода
+     */
+    void drainInputQueue();
+
+    /**
+     * Блокировка сигналов завершения и signalfd для них. Вызывается до
+     * запуска потока вывода эмулятора, чтобы поток унаследовал маску
+     */
+    bool setupSignals();
+
+    /**
+     * epoll над libinput, signalfd, eventfd пробуждения и управляющим сокетом
+     */
+    bool setupEventLoop();
+
+    /**
+     * Управляющий сокет: прием клиентов, одна команда на соединение
+     */
+    bool openControlSocket();
+    void acceptControlClients();
+    void handleControlClient(int client_fd);
+    void closeControlClient(int client_fd);
+    std::string executeControlCommand(const std::string& command);
+
+    /**
+     * Вычисление интенсивности скролла (в долях ступени) на основе скорости жеста
+     */
+    double calculateScrollIntensity(const MotionProfile& profile, double delta, double time_diff_ms) const;
+
+    /**
+     * Открытие libinput устройства
+     */
+    static int openRestricted(const char* path, int flags, void* user_data);
+
+    /**
+     * Закрытие libinput устройства
+     */
+    static void closeRestricted(int fd, void* user_data);
+};
+
+#endif // SCROLL_ENGINE_H
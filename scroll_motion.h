@@ -0,0 +1,141 @@
+#ifndef SCROLL_MOTION_H
+#define SCROLL_MOTION_H
+
+#include <cstdint>
+#include <cmath>
+
+// Накопитель дробного скролла по одной оси между обработчиком жестов и
+// ScrollEmulator.
+//
+// Обработчик передает движение в долях ступени колесика, накопитель хранит
+// его в фиксированной точке (1/256 hi-res единицы) и отдает только целые
+// hi-res единицы (1/120 ступени). Остаток переносится на следующие
+// обновления: медленное движение не округляется до целой ступени и не
+// теряется, а обновления меньше одной hi-res единицы не порождают событий.
+class ScrollAccumulator {
+public:
+    static const int HIRES_PER_DETENT = 120;
+    static const int FRACTION_BITS = 8;
+
+    ScrollAccumulator() : residual_(0) {}
+
+    // Добавляет движение в ступенях (со знаком), возвращает целые hi-res единицы к выводу
+    int add(double detents) {
+        residual_ += (int64_t)std::llround(detents * HIRES_PER_DETENT * (1 << FRACTION_BITS));
+
+        // Деление отбрасывает дробь к нулю: остаток сохраняет знак движения
+        int64_t units = residual_ / (1 << FRACTION_BITS);
+        residual_ -= units * (1 << FRACTION_BITS);
+        return (int)units;
+    }
+
+    // Остаток, еще не выведенный, в hi-res единицах
+    double pending() const {
+        return (double)residual_ / (1 << FRACTION_BITS);
+    }
+
+    void reset() {
+        residual_ = 0;
+    }
+
+private:
+    int64_t residual_;
+};
+
+// Оценка скорости жеста по кольцу последних образцов (время, dx, dy).
+//
+// Время - метки событий libinput в микросекундах (get_time_usec), а не
+// момент обработки, поэтому задержки обработчика скорость не искажают.
+// Скорость - наклон прямой, проведенной методом наименьших квадратов через
+// накопленный путь образцов за последние window_us: один дрожащий образец
+// влияет на нее слабее, чем на отношение последней дельты к интервалу.
+// Кольцо фиксированного размера, без выделения памяти и блокировок;
+// пишет и читает один поток (поток ввода).
+class VelocityEstimator {
+public:
+    static const int CAPACITY = 16;
+
+    VelocityEstimator() { reset(); }
+
+    void addSample(uint64_t time_us, double dx, double dy) {
+        Sample& sample = samples_[next_];
+        sample.time_us = time_us;
+        sample.x = dx;
+        sample.y = dy;
+        next_ = (next_ + 1) % CAPACITY;
+        if (count_ < CAPACITY) count_++;
+    }
+
+    // Скорость в единицах dx/dy в секунду. false - в окне меньше двух образцов
+    // или движение остановилось: последний образец старше window_us
+    bool velocity(uint64_t now_us, uint64_t window_us, double& vx, double& vy) const {
+        if (count_ < 2) return false;
+
+        const Sample& newest = back(0);
+        if (now_us > newest.time_us && now_us - newest.time_us > window_us) return false;
+
+        // Накопленный путь от нового образца к старым: позиция образца i
+        // относительно самого нового равна минус сумме дельт более новых
+        double t[CAPACITY], px[CAPACITY], py[CAPACITY];
+        int n = 0;
+        double pos_x = 0.0;
+        double pos_y = 0.0;
+        for (int i = 0; i < count_; i++) {
+            const Sample& sample = back(i);
+            if (newest.time_us - sample.time_us > window_us) break;
+            t[n] = -(double)(newest.time_us - sample.time_us) * 1e-6;
+            px[n] = pos_x;
+            py[n] = pos_y;
+            pos_x -= sample.x;
+            pos_y -= sample.y;
+            n++;
+        }
+        if (n < 2) return false;
+
+        double mean_t = 0.0, mean_x = 0.0, mean_y = 0.0;
+        for (int i = 0; i < n; i++) {
+            mean_t += t[i];
+            mean_x += px[i];
+            mean_y += py[i];
+        }
+        mean_t /= n;
+        mean_x /= n;
+        mean_y /= n;
+
+        double stt = 0.0, stx = 0.0, sty = 0.0;
+        for (int i = 0; i < n; i++) {
+            double dt = t[i] - mean_t;
+            stt += dt * dt;
+            stx += dt * (px[i] - mean_x);
+            sty += dt * (py[i] - mean_y);
+        }
+        if (stt <= 0.0) return false;
+
+        vx = stx / stt;
+        vy = sty / stt;
+        return true;
+    }
+
+    void reset() {
+        next_ = 0;
+        count_ = 0;
+    }
+
+private:
+    struct Sample {
+        uint64_t time_us;
+        double x;
+        double y;
+    };
+
+    // i-й образец с конца, 0 - самый новый
+    const Sample& back(int i) const {
+        return samples_[(next_ + CAPACITY - 1 - i) % CAPACITY];
+    }
+
+    Sample samples_[CAPACITY];
+    int next_;
+    int count_;
+};
+
+#endif // SCROLL_MOTION_H
@@ -0,0 +1,109 @@
+#ifndef SCROLL_PROTOCOL_H
+#define SCROLL_PROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+// Бинарный протокол между ScrollEmulator и uinput daemon'ом.
+//
+// Поток байт по unix socket состоит из кадров: заголовок ScrollFrameHeader,
+// за которым идут record_count записей ScrollRecord фиксированного размера.
+// Порядок байт - родной для машины (сокет локальный). Daemon разбирает поток
+// целиком, поэтому несколько кадров в одном recv() и кадр, разрезанный между
+// двумя recv(), обрабатываются без потерь.
+
+static const uint32_t SCROLL_PROTOCOL_MAGIC = 0x4c524353; // "SCRL"
+static const uint16_t SCROLL_PROTOCOL_VERSION = 1;
+static const uint16_t SCROLL_PROTOCOL_MAX_RECORDS = 256;
+// Наибольшая дельта одной записи в ступенях; больше daemon обрезает,
+// клиент делит длинные серии на несколько записей
+static const uint32_t SCROLL_MAX_DETENTS_PER_RECORD = 100;
+
+// Типы записей
+enum ScrollRecordType {
+    SCROLL_RECORD_WHEEL = 1,       // Колесико: delta в 1/120 ступени по оси axis
+    SCROLL_RECORD_PAGE = 2,        // Page Up (delta > 0) / Page Down (delta < 0)
+    SCROLL_RECORD_QUIT = 3,        // Клиент завершает работу
+    SCROLL_RECORD_SHM_ATTACH = 4,  // Подключение кольца в общей памяти (см. ниже)
+    SCROLL_RECORD_ZOOM = 5         // Вертикальное колесико с зажатым Ctrl: delta в 1/120 ступени (> 0 - приблизить)
+};
+
+// Оси колесика
+enum ScrollAxis {
+    SCROLL_AXIS_VERTICAL = 0,   // delta > 0 - вверх
+    SCROLL_AXIS_HORIZONTAL = 1  // delta > 0 - вправо
+};
+
+// Флаги записи
+enum ScrollRecordFlags {
+    // delta кратна целой ступени и выводится кадром на ступень одной
+    // записью в устройство. Пауз между ступенями daemon не делает:
+    // клиент с паузами delay_ms присылает по записи на ступень
+    SCROLL_FLAG_DETENTS = 1 << 0,
+    // Вместе с SCROLL_FLAG_DETENTS: все ступени одним кадром с суммарным
+    // значением (COALESCE_MERGE клиента)
+    SCROLL_FLAG_MERGE = 1 << 1
+};
+
+struct ScrollFrameHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_count;
+};
+
+struct ScrollRecord {
+    uint8_t type;
+    uint8_t axis;
+    uint16_t flags;
+    int32_t delta;          // Знаковая дельта, для колесика в 1/120 ступени
+    uint64_t timestamp_us;  // CLOCK_MONOTONIC клиента в момент создания записи
+};
+
+static_assert(sizeof(ScrollFrameHeader) == 8, "ScrollFrameHeader must be 8 bytes");
+static_assert(sizeof(ScrollRecord) == 16, "ScrollRecord must be 16 bytes");
+
+// Транспорт через общую память.
+//
+// Клиент создает memfd с заголовком ScrollRingHeader, за которым лежат
+// capacity записей ScrollRecord, и eventfd для пробуждения daemon'а, и
+// передает оба дескриптора через SCM_RIGHTS вместе с кадром из одной записи
+// SCROLL_RECORD_SHM_ATTACH (delta = capacity). Дальше записи кладутся в
+// кольцо без системных вызовов: клиент - единственный производитель (head),
+// daemon - единственный потребитель (tail). В eventfd клиент пишет только
+// если daemon выставил consumer_waiting, то есть уснул на пустом кольце.
+// Служебные записи (QUIT) по-прежнему идут через сокет; перед их обработкой
+// daemon вычитывает кольцо до конца.
+//
+// memfd создается с MFD_ALLOW_SEALING и печатями F_SEAL_SHRINK | F_SEAL_GROW,
+// без них daemon кольцо не принимает. Поле capacity заголовка daemon не
+// читает: емкость из записи SHM_ATTACH проверяется один раз и хранится у него.
+
+static const uint32_t SCROLL_RING_CAPACITY = 256;     // Степень двойки
+static const uint32_t SCROLL_RING_MAX_CAPACITY = 4096;
+
+#if ATOMIC_INT_LOCK_FREE != 2
+#error "Кольцо в общей памяти требует lock-free атомиков"
+#endif
+
+struct ScrollRingHeader {
+    std::atomic<uint32_t> head;             // Пишет клиент
+    char pad_head[60];
+    std::atomic<uint32_t> tail;             // Пишет daemon
+    char pad_tail[60];
+    std::atomic<uint32_t> consumer_waiting; // 1 - daemon ждет пробуждения через eventfd
+    uint32_t capacity;
+    char pad_state[56];
+};
+
+static_assert(sizeof(ScrollRingHeader) == 192, "ScrollRingHeader layout changed");
+
+inline ScrollRecord* scrollRingRecords(ScrollRingHeader* ring) {
+    return reinterpret_cast<ScrollRecord*>(ring + 1);
+}
+
+inline size_t scrollRingSize(uint32_t capacity) {
+    return sizeof(ScrollRingHeader) + capacity * sizeof(ScrollRecord);
+}
+
+#endif // SCROLL_PROTOCOL_H
@@ -22,12 +22,15 @@ void printUsage(const char* program_name) {
     std::cout << "  to-top               Скролл в начало документа\n";
     std::cout << "  to-bottom            Скролл в конец документа\n";
     std::cout << "  test                 Демонстрация всех функций\n";
+    std::cout << "  daemon               Постоянный uinput daemon для всех клиентов (до Ctrl+C)\n";
     std::cout << "  info                 Информация о методе эмуляции\n\n";
 
     std::cout << "ОПЦИИ:\n";
     std::cout << "  -d, --delay DELAY    Задержка между шагами в мс (по умолчанию 50)\n";
-    std::cout << "  -s, --smooth STEPS   Количество промежуточных шагов для плавности (по умолчанию 1)\n";
+    std::cout << "  -s, --smooth STEPS   Устарело, не влияет: плавность задает частота кадров -r\n";
     std::cout << "  -a, --accel FACTOR   Ускорение для плавного скролла (1.0 = постоянная скорость)\n";
+    std::cout << "  -r, --rate HZ        Частота кадров плавного скролла (по умолчанию 120)\n";
+    std::cout << "  -c, --coalesce MODE  Объединение шагов uinput: none, burst, merge (по умолчанию none)\n";
     std::cout << "  -v, --verbose        Подробный вывод\n";
     std::cout << "  -q, --quiet          Тихий режим\n";
     std::cout << "  -h, --help           Показать эту справку\n\n";
@@ -36,7 +39,10 @@ void printUsage(const char* program_name) {
     std::cout << "  " << program_name << " down 5                    # Скролл вниз на 5 шагов\n";
     std::cout << "  " << program_name << " -d 100 up 3               # Медленный скролл вверх\n";
     std::cout << "  " << program_name << " smooth-down 10 2000       # Плавный скролл вниз за 2 секунды\n";
-    std::cout << "  " << program_name << " -s 5 -a 1.5 smooth-up 20  # Плавный скролл с ускорением\n";
+    std::cout << "  " << program_name << " -a 1.5 smooth-up 20       # Плавный скролл с ускорением\n";
+    std::cout << "  " << program_name << " daemon &                  # Общий daemon: последующие вызовы без fork\n";
+    std::cout << "  " << program_name << " -r 240 smooth-down 5 500  # Плавный скролл с кадрами 240 Гц\n";
+    std::cout << "  " << program_name << " -c merge down 20          # 20 шагов одним кадром uinput\n";
     std::cout << "  " << program_name << " -v test                   # Демонстрация с подробным выводом\n\n";
 }
 
@@ -49,6 +55,8 @@ int main(int argc, char* argv[]) {
         {"delay",    required_argument, 0, 'd'},
         {"smooth",   required_argument, 0, 's'},
         {"accel",    required_argument, 0, 'a'},
+        {"rate",     required_argument, 0, 'r'},
+        {"coalesce", required_argument, 0, 'c'},
         {"verbose",  no_argument,       0, 'v'},
         {"quiet",    no_argument,       0, 'q'},
         {"help",     no_argument,       0, 'h'},
@@ -58,7 +66,7 @@ int main(int argc, char* argv[]) {
     int option_index = 0;
     int c;
 
-    while ((c = getopt_long(argc, argv, "d:s:a:vqh", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "d:s:a:r:c:vqh", long_options, &option_index)) != -1) {
         switch (c) {
             case 'd':
                 config.delay_ms = atoi(optarg);
@@ -81,6 +89,27 @@ int main(int argc, char* argv[]) {
                     return 1;
                 }
                 break;
+            case 'r':
+                config.frame_rate_hz = atoi(optarg);
+                if (config.frame_rate_hz < 1 || config.frame_rate_hz > 1000) {
+                    std::cerr << "Ошибка: частота кадров должна быть от 1 до 1000 Гц" << std::endl;
+                    return 1;
+                }
+                break;
+            case 'c': {
+                std::string mode = optarg;
+                if (mode == "none") {
+                    config.coalescing = ScrollEmulator::COALESCE_NONE;
+                } else if (mode == "burst") {
+                    config.coalescing = ScrollEmulator::COALESCE_BURST;
+                } else if (mode == "merge") {
+                    config.coalescing = ScrollEmulator::COALESCE_MERGE;
+                } else {
+                    std::cerr << "Ошибка: режим объединения должен быть none, burst или merge" << std::endl;
+                    return 1;
+                }
+                break;
+            }
             case 'v':
                 config.verbose = true;
                 break;
@@ -113,11 +142,22 @@ int main(int argc, char* argv[]) {
     ScrollEmulator emulator;
     emulator.setConfig(config);
 
+    // Постоянный daemon не выбирает метод вывода, а сам открывает uinput
+    if (command == "daemon") {
+        if (!emulator.serveDaemon()) {
+            if (!quiet) {
+                std::cerr << "Ошибка: daemon уже запущен или сокет недоступен" << std::endl;
+            }
+            return 1;
+        }
+        return 0;
+    }
+
     if (!emulator.initialize()) {
         if (!quiet) {
             std::cerr << "Ошибка: не удалось инициализировать эмулятор скролла" << std::endl;
             std::cerr << "Попробуйте:" << std::endl;
-            std::cerr << "1. Для X11: sudo apt install x11-xserver-utils" << std::endl;
+            std::cerr << "1. Для X11: sudo apt install libxtst-dev и пересоберите" << std::endl;
             std::cerr << "2. Для Wayland: настройте права на uinput" << std::endl;
             std::cerr << "3. Запустите с sudo" << std::endl;
         }
@@ -243,10 +283,12 @@ int main(int argc, char* argv[]) {
 
             std::cout << "3. Плавный скролл вниз..." << std::endl;
             emulator.smoothScrollDown(5, 2000);
+            emulator.waitIdle();
             sleep(1);
 
             std::cout << "4. Плавный скролл вверх..." << std::endl;
             emulator.smoothScrollUp(3, 1500);
+            emulator.waitIdle();
             sleep(1);
 
             std::cout << "5. Page Down..." << std::endl;
@@ -1,24 +1,11 @@
 #include "touch_scroll_handler.h"
 #include "scroll_emulator.h"
 #include <iostream>
-#include <csignal>
 #include <cstdlib>
 #include <unistd.h>
 #include <getopt.h>
 #include <string>
-
-// Глобальные переменные для обработчика сигналов
-static TouchScrollHandler* g_handler = nullptr;
-static bool g_running = true;
-
-// Обработчик сигналов для корректного завершения
-void signalHandler(int signal) {
-    std::cout << std::endl << "Получен сигнал " << signal << ", завершаем работу..." << std::endl;
-    g_running = false;
-    if (g_handler) {
-        g_handler->stop();
-    }
-}
+#include <vector>
 
 void printUsage(const char* program_name) {
     std::cout << "Использование: " << program_name << " [опции]" << std::endl;
@@ -31,18 +18,31 @@ void printUsage(const char* program_name) {
     std::cout << "  -v, --verbose       Подробный вывод событий" << std::endl;
     std::cout << "  -d, --daemon        Запуск в фоновом режиме" << std::endl;
     std::cout << "  --delay MS          Задержка между скроллами (по умолчанию 30мс)" << std::endl;
-    std::cout << "  --steps N           Количество шагов для плавной прокрутки (по умолчанию 3)" << std::endl;
+    std::cout << "  --steps N           Устарело, не влияет: hi-res вывод всегда дробный" << std::endl;
     std::cout << "  --accel FLOAT       Ускорение прокрутки (по умолчанию 1.2)" << std::endl;
+    std::cout << "  --no-inertia        Не продолжать прокрутку по инерции после отрыва пальцев" << std::endl;
+    std::cout << "  --bind SPEC         Назначить действие жесту: touch:ПАЛЬЦЫ=ДЕЙСТВИЕ (можно повторять)" << std::endl;
+    std::cout << "                      Действия: scroll, page, fling, edge, none" << std::endl;
+    std::cout << "  --bindings FILE     Загрузить назначения из файла (по одному на строку, # - комментарий)" << std::endl;
+    std::cout << "  --control PATH      Управляющий unix сокет: команды stop, cancel, status" << std::endl;
+    std::cout << "  --device DEVICE     Использовать только этот экран: имя libinput, eventN или vid:pid (можно повторять)" << std::endl;
+    std::cout << "  --path FILE         Открыть только экран /dev/input/eventN без udev и seat (можно повторять)" << std::endl;
+    std::cout << "  --seat NAME         Seat для поиска устройств через udev (по умолчанию seat0)" << std::endl;
+    std::cout << "  --input-thread      Читать сенсорный экран в отдельном потоке ввода" << std::endl;
+    std::cout << "  --rt-priority N     Приоритет реального времени потока ввода (1-99, нужна CAP_SYS_NICE)" << std::endl;
+    std::cout << "  --rt-policy POLICY  Политика планировщика потока ввода: fifo (по умолчанию) или rr" << std::endl;
+    std::cout << "  --cpu N             Привязать поток ввода к CPU N" << std::endl;
     std::cout << "  --test              Тестовый режим с пробными командами прокрутки" << std::endl;
     std::cout << std::endl;
     std::cout << "Примеры:" << std::endl;
     std::cout << "  " << program_name << " -v                      # С подробным выводом" << std::endl;
     std::cout << "  " << program_name << " --daemon                # В фоновом режиме" << std::endl;
-    std::cout << "  " << program_name << " --delay 20 --steps 5    # Настроенная конфигурация" << std::endl;
+    std::cout << "  " << program_name << " --delay 20              # Настроенная конфигурация" << std::endl;
+    std::cout << "  " << program_name << " --bind touch:2=scroll   # Прокрутка двумя пальцами" << std::endl;
     std::cout << "  " << program_name << " --test                  # Тестирование системы" << std::endl;
     std::cout << std::endl;
     std::cout << "Жесты:" << std::endl;
-    std::cout << "  - Касание 3 пальцами + движение по экрану = плавная прокрутка" << std::endl;
+    std::cout << "  - Касание 3 пальцами + движение по экрану = плавная прокрутка (меняется через --bind)" << std::endl;
     std::cout << "  - Движение вверх/вниз = вертикальная прокрутка" << std::endl;
     std::cout << "  - Движение влево/вправо = горизонтальная прокрутка" << std::endl;
     std::cout << std::endl;
@@ -97,6 +97,13 @@ int main(int argc, char* argv[]) {
     int delay_ms = 30;
     int steps = 3;
     double acceleration = 1.2;
+    bool kinetic = true;
+    GestureBindings bindings;
+    std::string control_path;
+    ScrollEngine::InputThreadConfig input_thread;
+    std::vector<ScrollEngine::DeviceFilter> device_filters;
+    std::vector<std::string> device_paths;
+    std::string seat;
     
     // Парсинг аргументов командной строки
     static struct option long_options[] = {
@@ -107,6 +114,17 @@ int main(int argc, char* argv[]) {
         {"steps", required_argument, 0, 1},
         {"accel", required_argument, 0, 2},
         {"test", no_argument, 0, 3},
+        {"no-inertia", no_argument, 0, 4},
+        {"bind", required_argument, 0, 5},
+        {"bindings", required_argument, 0, 6},
+        {"control", required_argument, 0, 7},
+        {"input-thread", no_argument, 0, 8},
+        {"rt-priority", required_argument, 0, 9},
+        {"rt-policy", required_argument, 0, 10},
+        {"cpu", required_argument, 0, 11},
+        {"device", required_argument, 0, 12},
+        {"path", required_argument, 0, 13},
+        {"seat", required_argument, 0, 14},
         {0, 0, 0, 0}
     };
     
@@ -135,6 +153,65 @@ int main(int argc, char* argv[]) {
             case 3: // --test
                 test_mode = true;
                 break;
+            case 4: // --no-inertia
+                kinetic = false;
+                break;
+            case 5: // --bind
+                if (!bindings.parseBinding(optarg)) {
+                    return 1;
+                }
+                break;
+            case 6: // --bindings
+                if (!bindings.loadFile(optarg)) {
+                    return 1;
+                }
+                break;
+            case 7: // --control
+                control_path = optarg;
+                break;
+            case 8: // --input-thread
+                input_thread.enabled = true;
+                break;
+            case 9: // --rt-priority
+                input_thread.priority = std::stoi(optarg);
+                if (input_thread.priority < 1 || input_thread.priority > 99) {
+                    std::cerr << "Ошибка: приоритет реального времени должен быть от 1 до 99" << std::endl;
+                    return 1;
+                }
+                input_thread.enabled = true;
+                break;
+            case 10: // --rt-policy
+                if (std::string(optarg) == "fifo") {
+                    input_thread.policy = SCHED_FIFO;
+                } else if (std::string(optarg) == "rr") {
+                    input_thread.policy = SCHED_RR;
+                } else {
+                    std::cerr << "Ошибка: политика планировщика должна быть fifo или rr" << std::endl;
+                    return 1;
+                }
+                break;
+            case 11: // --cpu
+                input_thread.cpu = std::stoi(optarg);
+                if (input_thread.cpu < 0 || input_thread.cpu >= CPU_SETSIZE) {
+                    std::cerr << "Ошибка: неверный номер CPU: " << optarg << std::endl;
+                    return 1;
+                }
+                input_thread.enabled = true;
+                break;
+            case 12: { // --device
+                ScrollEngine::DeviceFilter filter;
+                if (!ScrollEngine::DeviceFilter::parse(optarg, filter)) {
+                    return 1;
+                }
+                device_filters.push_back(filter);
+                break;
+            }
+            case 13: // --path
+                device_paths.push_back(optarg);
+                break;
+            case 14: // --seat
+                seat = optarg;
+                break;
             case '?':
                 std::cerr << "Неизвестная опция. Используйте --help для справки." << std::endl;
                 return 1;
@@ -159,23 +236,22 @@ int main(int argc, char* argv[]) {
         verbose = false; // Отключаем verbose в daemon режиме
     }
     
-    // Настройка обработчиков сигналов
-    signal(SIGINT, signalHandler);   // Ctrl+C
-    signal(SIGTERM, signalHandler);  // Terminate
-    signal(SIGHUP, signalHandler);   // Hangup
-    
     if (!daemon_mode) {
         std::cout << "=== Touch Scroll Daemon ===" << std::endl;
         std::cout << "Плавная прокрутка 3 пальцами на сенсорном экране" << std::endl;
         std::cout << "Адаптирован для Plasma Mobile" << std::endl;
         std::cout << "Настройки: задержка=" << delay_ms << "мс, шаги=" << steps 
                   << ", ускорение=" << acceleration << std::endl;
+        if (verbose) {
+            std::cout << "Назначения жестов:" << std::endl;
+            bindings.print(GestureType::TOUCH);
+        }
         std::cout << std::endl;
     }
     
     // Инициализация обработчика touch событий
+    // SIGINT/SIGTERM/SIGHUP обрабатывает цикл событий через signalfd
     TouchScrollHandler handler;
-    g_handler = &handler;
     
     // Настройка verbose режима
     handler.setVerbose(verbose);
@@ -185,7 +261,20 @@ int main(int argc, char* argv[]) {
     config.delay_ms = delay_ms;
     config.smooth_steps = steps;
     config.acceleration = static_cast<float>(acceleration);
+    config.kinetic_scrolling = kinetic;
+    config.shared_memory_transport = true; // Скролл почти на каждое событие - без send() на каждое
     handler.setScrollConfig(config);
+    handler.setBindings(bindings);
+    handler.setControlSocket(control_path);
+    handler.setInputThread(input_thread);
+    handler.setDeviceFilters(device_filters);
+    handler.setDevicePaths(device_paths);
+    if (!seat.empty()) {
+        if (!device_paths.empty()) {
+            std::cerr << "Предупреждение: --seat не действует вместе с --path" << std::endl;
+        }
+        handler.setSeat(seat);
+    }
     
     // Инициализация
     if (!handler.initialize()) {
@@ -218,7 +307,6 @@ int main(int argc, char* argv[]) {
     
     // Очистка
     handler.cleanup();
-    g_handler = nullptr;
     
     return 0;
 } 
\ No newline at end of file
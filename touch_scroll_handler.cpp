@@ -1,235 +1,95 @@
 #include "touch_scroll_handler.h"
 #include <iostream>
-#include <algorithm>
-#include <cmath>
-#include <unistd.h>
-#include <fcntl.h>
-#include <poll.h>
-#include <signal.h>
-#include <cstring>  // для strerror
-#include <cerrno>   // для errno
 
-TouchScrollHandler::TouchScrollHandler() 
-    : li_(nullptr), udev_(nullptr), fd_(-1), running_(false), verbose_(false) {
-    scroll_emulator_.reset(new ScrollEmulator());  // Используем reset вместо make_unique для C++11
-}
-
-TouchScrollHandler::~TouchScrollHandler() {
-    cleanup();
-}
-
-bool TouchScrollHandler::initialize() {
-    if (verbose_) {
-        std::cout << "=== Инициализация TouchScrollHandler ===" << std::endl;
-    }
-    
-    // Инициализируем scroll emulator
-    if (!scroll_emulator_->initialize()) {
-        std::cerr << "Ошибка: не удалось инициализировать ScrollEmulator" << std::endl;
-        return false;
-    }
-    
-    if (verbose_) {
-        std::cout << "✓ ScrollEmulator инициализирован: " << scroll_emulator_->getMethod() << std::endl;
-    }
-    
-    // Создаем udev контекст
-    udev_ = udev_new();
-    if (!udev_) {
-        std::cerr << "Ошибка: не удалось создать udev контекст" << std::endl;
-        return false;
-    }
-    
-    // Настройка интерфейса libinput
-    static const struct libinput_interface interface = {
-        .open_restricted = openRestricted,
-        .close_restricted = closeRestricted,
-    };
-    
-    // Создаем контекст libinput для udev
-    li_ = libinput_udev_create_context(&interface, this, udev_);
-    if (!li_) {
-        std::cerr << "Ошибка: не удалось создать контекст libinput" << std::endl;
-        std::cerr << "Возможные причины:" << std::endl;
-        std::cerr << "  - Нет прав доступа к /dev/input/*" << std::endl;
-        std::cerr << "  - Нужно добавить пользователя в группу input" << std::endl;
-        std::cerr << "  - Или запустить с sudo" << std::endl;
-        udev_unref(udev_);
-        udev_ = nullptr;
-        return false;
-    }
-    
-    // Добавляем все устройства из текущего сеанса
-    if (libinput_udev_assign_seat(li_, "seat0") != 0) {
-        std::cerr << "Ошибка: не удалось назначить seat0" << std::endl;
-        libinput_unref(li_);
-        li_ = nullptr;
-        udev_unref(udev_);
-        udev_ = nullptr;
-        return false;
-    }
-    
-    fd_ = libinput_get_fd(li_);
-    if (fd_ < 0) {
-        std::cerr << "Ошибка: не удалось получить файловый дескриптор libinput" << std::endl;
-        libinput_unref(li_);
-        li_ = nullptr;
-        udev_unref(udev_);
-        udev_ = nullptr;
-        return false;
-    }
-    
-    if (verbose_) {
-        std::cout << "✓ libinput инициализирован для сенсорных экранов" << std::endl;
-    }
-    
-    return true;
-}
-
-void TouchScrollHandler::cleanup() {
-    running_ = false;
-    
-    if (li_) {
-        libinput_unref(li_);
-        li_ = nullptr;
-    }
-    
-    if (udev_) {
-        udev_unref(udev_);
-        udev_ = nullptr;
-    }
-    
-    if (scroll_emulator_) {
-        scroll_emulator_.reset();
-    }
-}
-
-void TouchScrollHandler::setScrollConfig(const ScrollEmulator::ScrollConfig& config) {
-    if (scroll_emulator_) {
-        scroll_emulator_->setConfig(config);
-    }
-}
-
-void TouchScrollHandler::run() {
-    if (!li_) {
-        std::cerr << "Ошибка: обработчик не инициализирован" << std::endl;
-        return;
-    }
-    
-    running_ = true;
-    
-    if (verbose_) {
-        std::cout << "Начинаем обработку touch жестов..." << std::endl;
-        std::cout << "Используйте 3 пальца на сенсорном экране для скролла (Ctrl+C для выхода)" << std::endl;
-    }
-    
-    struct pollfd fds;
-    fds.fd = fd_;
-    fds.events = POLLIN;
-    
-    while (running_) {
-        int ret = poll(&fds, 1, 100); // Таймаут 100мс
+// Сенсорный экран: абсолютные координаты в мм, более крупный порог начала
+const MotionProfile TouchGestureSource::PROFILE = {
+    15.0,  // start_threshold (больше для touch)
+    3.0,   // scroll_threshold
+    20,    // min_scroll_interval_ms
+    5.0,   // intensity_divisor (для touch экранов другая шкала)
+    40.0,  // time_scale_ms
+    15.0,  // max_intensity
+    30,    // smooth_duration_ms
+    "Touch жест",   // gesture_label
+    "Touch скролл"  // scroll_label
+};
+
+TouchGestureSource::TouchGestureSource(ScrollEngine& engine)
+    : engine_(engine) {
+}
+
+bool TouchGestureSource::handleEvent(const InputEvent& event) {
+    switch (event.type) {
+        case LIBINPUT_EVENT_TOUCH_DOWN:
+            handleTouchDown(event);
+            return true;
         
-        if (ret < 0) {
-            if (errno == EINTR) {
-                continue; // Прерывание сигналом
-            }
-            std::cerr << "Ошибка poll: " << strerror(errno) << std::endl;
-            break;
-        }
+        case LIBINPUT_EVENT_TOUCH_MOTION:
+            handleTouchMotion(event);
+            return true;
         
-        if (ret > 0 && (fds.revents & POLLIN)) {
-            processEvents();
-        }
-    }
-    
-    if (verbose_) {
-        std::cout << "Обработка touch жестов завершена" << std::endl;
-    }
-}
-
-void TouchScrollHandler::stop() {
-    running_ = false;
-}
-
-void TouchScrollHandler::processEvents() {
-    libinput_dispatch(li_);
-    
-    struct libinput_event *event;
-    while ((event = libinput_get_event(li_))) {
-        enum libinput_event_type type = libinput_event_get_type(event);
+        case LIBINPUT_EVENT_TOUCH_FRAME:
+            handleTouchFrame();
+            return true;
         
-        switch (type) {
-            case LIBINPUT_EVENT_TOUCH_DOWN: {
-                struct libinput_event_touch *touch = 
-                    libinput_event_get_touch_event(event);
-                handleTouchDown(touch);
-                break;
-            }
-            
-            case LIBINPUT_EVENT_TOUCH_MOTION: {
-                struct libinput_event_touch *touch = 
-                    libinput_event_get_touch_event(event);
-                handleTouchMotion(touch);
-                break;
-            }
-            
-            case LIBINPUT_EVENT_TOUCH_UP:
-            case LIBINPUT_EVENT_TOUCH_CANCEL: {
-                struct libinput_event_touch *touch = 
-                    libinput_event_get_touch_event(event);
-                handleTouchUp(touch);
-                break;
-            }
-            
-            default:
-                // Игнорируем другие события
-                break;
-        }
+        case LIBINPUT_EVENT_TOUCH_UP:
+        case LIBINPUT_EVENT_TOUCH_CANCEL:
+            handleTouchUp(event);
+            return true;
         
-        libinput_event_destroy(event);
+        default:
+            // Остальные события - другим источникам
+            return false;
     }
 }
 
-void TouchScrollHandler::handleTouchDown(struct libinput_event_touch* touch) {
+void TouchGestureSource::handleTouchDown(const InputEvent& event) {
     touch_state_.current_fingers++;
     
-    int32_t slot = libinput_event_touch_get_slot(touch);
-    double x = libinput_event_touch_get_x(touch);
-    double y = libinput_event_touch_get_y(touch);
-    
-    touch_state_.start_x[slot] = x;
-    touch_state_.start_y[slot] = y;
-    touch_state_.current_x[slot] = x;
-    touch_state_.current_y[slot] = y;
+    touch_state_.addSlot(event.slot, event.x, event.y);
     
     // Сохраняем количество пальцев при начале жеста
     if (touch_state_.current_fingers == 1) {
+        // Новое касание останавливает инерцию предыдущего жеста
+        engine_.emulator().cancelScroll();
         touch_state_.gesture_start_time = std::chrono::steady_clock::now();
         touch_state_.total_delta_x = 0.0;
         touch_state_.total_delta_y = 0.0;
     }
     
-    if (verbose_ && touch_state_.current_fingers == 3) {
-        std::cout << "Началось касание 3 пальцами на экране" << std::endl;
+    if (engine_.verbose() && !touch_state_.active &&
+        engine_.bindings().lookup(GestureType::TOUCH, touch_state_.current_fingers) != GestureAction::NONE) {
+        std::cout << "Началось касание " << touch_state_.current_fingers << " пальцами на экране" << std::endl;
     }
 }
 
-void TouchScrollHandler::handleTouchMotion(struct libinput_event_touch* touch) {
-    // Обрабатываем только жесты с 3 пальцами
-    if (touch_state_.current_fingers != 3) {
+void TouchGestureSource::handleTouchMotion(const InputEvent& event) {
+    // Обрабатываем только жесты, которым назначено действие
+    if (!isBoundTouch()) {
         return;
     }
     
-    int32_t slot = libinput_event_touch_get_slot(touch);
-    double x = libinput_event_touch_get_x(touch);
-    double y = libinput_event_touch_get_y(touch);
+    // Только запоминаем позицию: решение о скролле принимается один раз
+    // на аппаратный кадр в handleTouchFrame
+    touch_state_.moveSlot(event.slot, event.x, event.y);
+    touch_state_.frame_pending = true;
+    touch_state_.frame_time_us = event.time_us;
+}
+
+void TouchGestureSource::handleTouchFrame() {
+    if (!touch_state_.frame_pending) {
+        return;
+    }
+    touch_state_.frame_pending = false;
     
-    // Обновляем текущую позицию
-    touch_state_.current_x[slot] = x;
-    touch_state_.current_y[slot] = y;
+    // Обрабатываем только жесты, которым назначено действие
+    if (!isBoundTouch()) {
+        return;
+    }
+    
+    uint64_t time_us = touch_state_.frame_time_us;
     
-    // Вычисляем среднее движение всех пальцев
+    // Смещение центра касаний по всем слотам кадра
     std::pair<double, double> delta_pair = touch_state_.getAverageDelta();
     double avg_delta_x = delta_pair.first;
     double avg_delta_y = delta_pair.second;
@@ -239,151 +99,91 @@ void TouchScrollHandler::handleTouchMotion(struct libinput_event_touch* touch) {
     touch_state_.total_delta_y = avg_delta_y;
     
     if (!touch_state_.active) {
-        // Проверяем, достигли ли мы порога для начала жеста
-        double total_movement = std::sqrt(
-            touch_state_.total_delta_x * touch_state_.total_delta_x +
-            touch_state_.total_delta_y * touch_state_.total_delta_y
-        );
-        
-        if (total_movement > TouchScrollState::START_THRESHOLD) {
-            touch_state_.active = true;
+        // Действие выбирается по числу пальцев в момент активации
+        touch_state_.action = engine_.bindings().lookup(GestureType::TOUCH, touch_state_.current_fingers);
+        if (engine_.tryActivate(touch_state_, PROFILE, time_us)) {
             touch_state_.start_fingers = touch_state_.current_fingers;
-            touch_state_.last_scroll_time = std::chrono::steady_clock::now();
-            
-            if (verbose_) {
-                TouchDirection dir = calculateDirection(
-                    touch_state_.total_delta_x, touch_state_.total_delta_y);
-                std::cout << "Touch жест активирован, направление: " << static_cast<int>(dir) << std::endl;
-            }
         }
     }
     
-    if (touch_state_.active && shouldScroll()) {
+    // Страница и край документа срабатывают один раз при активации
+    if (ScrollEngine::isContinuous(touch_state_.action) && touch_state_.active &&
+        engine_.shouldScroll(touch_state_, PROFILE, time_us)) {
         // Для touch экранов используем небольшое движение для плавности
-        double motion_delta_x = (touch_state_.current_x.count(slot) && touch_state_.start_x.count(slot)) 
-                               ? touch_state_.current_x[slot] - touch_state_.start_x[slot] : 0.0;
-        double motion_delta_y = (touch_state_.current_y.count(slot) && touch_state_.start_y.count(slot))
-                               ? touch_state_.current_y[slot] - touch_state_.start_y[slot] : 0.0;
-        
-        performSmoothScroll(motion_delta_x / 100.0, motion_delta_y / 100.0); // Масштабируем для touch
-        touch_state_.last_scroll_time = std::chrono::steady_clock::now();
+        engine_.performSmoothScroll(touch_state_, PROFILE,
+                                    avg_delta_x / 100.0, avg_delta_y / 100.0, time_us); // Масштабируем для touch
+        touch_state_.last_scroll_time_us = time_us;
     }
 }
 
-void TouchScrollHandler::handleTouchUp(struct libinput_event_touch* touch) {
-    touch_state_.current_fingers--;
+void TouchGestureSource::handleTouchUp(const InputEvent& event) {
+    // Отрыв первого из пальцев активного жеста завершает его; отмененное
+    // системой касание инерции не дает
+    bool cancelled = event.type == LIBINPUT_EVENT_TOUCH_CANCEL;
+    if (ScrollEngine::isContinuous(touch_state_.action) && touch_state_.active && !cancelled &&
+        touch_state_.current_fingers == touch_state_.start_fingers) {
+        engine_.startFling(touch_state_, event.time_us);
+    }
     
-    int32_t slot = libinput_event_touch_get_slot(touch);
+    touch_state_.current_fingers--;
     
     if (touch_state_.current_fingers == 0) {
-        if (touch_state_.active && verbose_) {
+        if (touch_state_.active && engine_.verbose()) {
             std::cout << "Touch жест завершен" << std::endl;
         }
         touch_state_.reset();
     }
     
-    // Удаляем данные о этом слоте
-    touch_state_.start_x.erase(slot);
-    touch_state_.start_y.erase(slot);
-    touch_state_.current_x.erase(slot);
-    touch_state_.current_y.erase(slot);
+    // Освобождаем слот
+    touch_state_.removeSlot(event.slot);
 }
 
-TouchDirection TouchScrollHandler::calculateDirection(double delta_x, double delta_y) {
-    double abs_x = std::abs(delta_x);
-    double abs_y = std::abs(delta_y);
-    
-    if (abs_x > abs_y) {
-        return (delta_x > 0) ? TouchDirection::RIGHT : TouchDirection::LEFT;
-    } else {
-        return (delta_y > 0) ? TouchDirection::DOWN : TouchDirection::UP;
+bool TouchGestureSource::isBoundTouch() const {
+    if (touch_state_.active) {
+        return touch_state_.current_fingers == touch_state_.start_fingers;
     }
+    return engine_.bindings().lookup(GestureType::TOUCH, touch_state_.current_fingers) != GestureAction::NONE;
 }
 
-void TouchScrollHandler::performSmoothScroll(double delta_x, double delta_y) {
-    // Определяем основное направление движения
-    double abs_x = std::abs(delta_x);
-    double abs_y = std::abs(delta_y);
-    
-    // Вычисляем временную разность для адаптации скорости
-    auto now = std::chrono::steady_clock::now();
-    auto time_diff = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now - touch_state_.last_scroll_time).count();
-    
-    if (time_diff == 0) time_diff = 1; // Избегаем деления на ноль
-    
-    // Вертикальная прокрутка (приоритет)
-    if (abs_y > TouchScrollState::SCROLL_THRESHOLD) {
-        int intensity = calculateScrollIntensity(abs_y, time_diff);
-        
-        if (delta_y < 0) {
-            // Движение вверх = скролл вверх
-            scroll_emulator_->smoothScrollUp(intensity, 30);
-            if (verbose_) {
-                std::cout << "↑ Touch скролл вверх: " << intensity << std::endl;
-            }
-        } else {
-            // Движение вниз = скролл вниз  
-            scroll_emulator_->smoothScrollDown(intensity, 30);
-            if (verbose_) {
-                std::cout << "↓ Touch скролл вниз: " << intensity << std::endl;
-            }
-        }
-    }
-    // Горизонтальная прокрутка (если вертикальное движение меньше)
-    else if (abs_x > TouchScrollState::SCROLL_THRESHOLD) {
-        int intensity = calculateScrollIntensity(abs_x, time_diff);
-        
-        if (delta_x < 0) {
-            // Движение влево = скролл влево
-            scroll_emulator_->smoothScrollLeft(intensity, 30);
-            if (verbose_) {
-                std::cout << "← Touch скролл влево: " << intensity << std::endl;
-            }
-        } else {
-            // Движение вправо = скролл вправо
-            scroll_emulator_->smoothScrollRight(intensity, 30);
-            if (verbose_) {
-                std::cout << "→ Touch скролл вправо: " << intensity << std::endl;
-            }
-        }
-    }
+TouchScrollHandler::TouchScrollHandler()
+    : verbose_(false) {
 }
 
-bool TouchScrollHandler::shouldScroll() {
-    auto now = std::chrono::steady_clock::now();
-    auto time_since_last = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now - touch_state_.last_scroll_time).count();
-    
-    return time_since_last >= TouchScrollState::MIN_SCROLL_INTERVAL_MS;
+TouchScrollHandler::~TouchScrollHandler() {
+    cleanup();
 }
 
-int TouchScrollHandler::calculateScrollIntensity(double delta, double time_diff_ms) {
-    // Базовая интенсивность на основе размера движения (для touch экранов другая шкала)
-    double base_intensity = std::abs(delta) / 5.0;
-    
-    // Корректировка на основе времени (чем быстрее, тем интенсивнее)
-    double time_factor = 40.0 / std::max(1.0, static_cast<double>(time_diff_ms));
+bool TouchScrollHandler::initialize() {
+    if (verbose_) {
+        std::cout << "=== Инициализация TouchScrollHandler ===" << std::endl;
+    }
     
-    // Комбинируем факторы
-    double intensity = base_intensity * time_factor;
+    engine_.addSource(new TouchGestureSource(engine_));
     
-    // Ограничиваем диапазон для touch экранов
-    return std::max(1, std::min(15, static_cast<int>(intensity)));
+    return engine_.initialize();
 }
 
-int TouchScrollHandler::openRestricted(const char* path, int flags, void* user_data) {
-    int fd = open(path, flags);
-    if (fd < 0) {
-        TouchScrollHandler* handler = static_cast<TouchScrollHandler*>(user_data);
-        if (handler && handler->verbose_) {
-            std::cerr << "Не удалось открыть " << path << ": " << strerror(errno) << std::endl;
-        }
+void TouchScrollHandler::cleanup() {
+    engine_.cleanup();
+}
+
+void TouchScrollHandler::setScrollConfig(const ScrollEmulator::ScrollConfig& config) {
+    engine_.setScrollConfig(config);
+}
+
+void TouchScrollHandler::run() {
+    if (verbose_) {
+        std::cout << "Начинаем обработку touch жестов..." << std::endl;
+        std::cout << "Используйте 3 пальца на сенсорном экране для скролла (Ctrl+C для выхода)" << std::endl;
+    }
+    
+    engine_.run();
+    
+    if (verbose_) {
+        std::cout << "Обработка touch жестов завершена" << std::endl;
     }
-    return fd;
 }
 
-void TouchScrollHandler::closeRestricted(int fd, void* user_data) {
-    (void)user_data;  // Подавляем предупреждение о неиспользованном параметре
-    close(fd);
-} 
\ No newline at end of file
+void TouchScrollHandler::stop() {
+    engine_.stop();
+}
@@ -1,187 +1,240 @@
 #ifndef TOUCH_SCROLL_HANDLER_H
 #define TOUCH_SCROLL_HANDLER_H
 
-#include <libinput.h>
-#include <libudev.h>
-#include <memory>
-#include <chrono>
-#include <unordered_map>
-#include "scroll_emulator.h"
+#include "scroll_engine.h"
 
 /**
- * Состояние touch жеста для отслеживания 3-пальцевого скролла на сенсорном экране
+ * Состояние touch жеста для отслеживания многопальцевого скролла на сенсорном экране
  */
-struct TouchScrollState {
-    bool active = false;
+struct TouchScrollState : MotionState {
     int current_fingers = 0;
     int start_fingers = 0;
-    std::chrono::steady_clock::time_point last_scroll_time;
-    std::chrono::steady_clock::time_point gesture_start_time;
     
-    // Позиции пальцев (slot -> координата)
-    std::unordered_map<int32_t, double> start_x;
-    std::unordered_map<int32_t, double> start_y;
-    std::unordered_map<int32_t, double> current_x;
-    std::unordered_map<int32_t, double> current_y;
-    
-    // Накопленные дельты для определения направления
-    double total_delta_x = 0.0;
-    double total_delta_y = 0.0;
-    
-    // Пороги для определения направления и начала скролла
-    static constexpr double START_THRESHOLD = 15.0;  // Минимальное движение для начала (больше для touch)
-    static constexpr double SCROLL_THRESHOLD = 3.0;  // Минимальное движение для продолжения скролла
-    static constexpr int MIN_SCROLL_INTERVAL_MS = 20; // Минимальный интервал между скроллами
+    // Позиции пальцев по слотам; занятые слоты отмечены в active_slots.
+    // Массивы фиксированного размера: на касание и движение нет ни выделений
+    // памяти, ни хеширования
+    static constexpr int MAX_SLOTS = 16;
+    double start_x[MAX_SLOTS];
+    double start_y[MAX_SLOTS];
+    double current_x[MAX_SLOTS];
+    double current_y[MAX_SLOTS];
+    uint32_t active_slots = 0;
+    
+    // Суммы позиций занятых слотов: центр касаний за O(1) на событие
+    int slot_count = 0;
+    double sum_start_x = 0.0;
+    double sum_start_y = 0.0;
+    double sum_current_x = 0.0;
+    double sum_current_y = 0.0;
+    
+    // Движение слотов с последнего LIBINPUT_EVENT_TOUCH_FRAME еще не обработано
+    bool frame_pending = false;
+    uint64_t frame_time_us = 0;
     
     void reset() {
-        active = false;
+        resetMotion();
         current_fingers = 0;
         start_fingers = 0;
-        start_x.clear();
-        start_y.clear();
-        current_x.clear();
-        current_y.clear();
-        total_delta_x = 0.0;
-        total_delta_y = 0.0;
+        active_slots = 0;
+        clearSums();
+        frame_pending = false;
     }
     
-    // Вычисление среднего движения всех пальцев
-    std::pair<double, double> getAverageDelta() const {
-        if (start_x.empty() || current_x.empty()) {
-            return std::make_pair(0.0, 0.0);
+    // Слот занят пальцем (слоты вне MAX_SLOTS не отслеживаются)
+    bool hasSlot(int32_t slot) const {
+        return slot >= 0 && slot < MAX_SLOTS && (active_slots & (1u << slot));
+    }
+    
+    // Касание: начальная и текущая позиция слота
+    void addSlot(int32_t slot, double x, double y) {
+        if (slot < 0 || slot >= MAX_SLOTS) return;
+        if (hasSlot(slot)) removeSlot(slot);
+        start_x[slot] = x;
+        start_y[slot] = y;
+        current_x[slot] = x;
+        current_y[slot] = y;
+        active_slots |= 1u << slot;
+        slot_count++;
+        sum_start_x += x;
+        sum_start_y += y;
+        sum_current_x += x;
+        sum_current_y += y;
+    }
+    
+    // Движение занятого слота
+    void moveSlot(int32_t slot, double x, double y) {
+        if (!hasSlot(slot)) return;
+        sum_current_x += x - current_x[slot];
+        sum_current_y += y - current_y[slot];
+        current_x[slot] = x;
+        current_y[slot] = y;
+    }
+    
+    // Отрыв пальца
+    void removeSlot(int32_t slot) {
+        if (!hasSlot(slot)) return;
+        active_slots &= ~(1u << slot);
+        if (--slot_count == 0) {
+            // Сбрасываем суммы, чтобы ошибка округления не копилась между жестами
+            clearSums();
+            return;
         }
-        
-        double delta_x = 0.0;
-        double delta_y = 0.0;
-        int count = 0;
-        
-        for (const auto& pair : start_x) {
-            int32_t slot = pair.first;
-            if (current_x.count(slot) && current_y.count(slot) && start_y.count(slot)) {
-                delta_x += current_x.at(slot) - start_x.at(slot);
-                delta_y += current_y.at(slot) - start_y.at(slot);
-                count++;
-            }
+        sum_start_x -= start_x[slot];
+        sum_start_y -= start_y[slot];
+        sum_current_x -= current_x[slot];
+        sum_current_y -= current_y[slot];
+    }
+    
+    // Текущий центр касаний
+    std::pair<double, double> getCentroid() const {
+        if (slot_count == 0) {
+            return std::make_pair(0.0, 0.0);
         }
-        
-        if (count > 0) {
-            delta_x /= count;
-            delta_y /= count;
+        return std::make_pair(sum_current_x / slot_count, sum_current_y / slot_count);
+    }
+    
+    // Вычисление среднего движения всех пальцев (смещение центра от начальных позиций)
+    std::pair<double, double> getAverageDelta() const {
+        if (slot_count == 0) {
+            return std::make_pair(0.0, 0.0);
         }
-        
-        return std::make_pair(delta_x, delta_y);
+        return std::make_pair((sum_current_x - sum_start_x) / slot_count,
+                              (sum_current_y - sum_start_y) / slot_count);
+    }
+    
+    void clearSums() {
+        slot_count = 0;
+        sum_start_x = 0.0;
+        sum_start_y = 0.0;
+        sum_current_x = 0.0;
+        sum_current_y = 0.0;
     }
 };
 
 /**
- * Направления touch жестов
+ * Направления touch жестов (прежнее имя GestureDirection)
  */
-enum class TouchDirection {
-    UNKNOWN = 0,
-    UP = 1,
-    DOWN = 2,
-    LEFT = 3,
-    RIGHT = 4
-};
+typedef GestureDirection TouchDirection;
 
 /**
- * Обработчик touch событий для плавной прокрутки на сенсорных экранах
+ * Источник жестов сенсорного экрана: касания по слотам, одно решение на аппаратный кадр
  * Адаптирован для Plasma Mobile и других touch-устройств
  */
-class TouchScrollHandler {
+class TouchGestureSource : public GestureSource {
 public:
-    TouchScrollHandler();
-    ~TouchScrollHandler();
+    explicit TouchGestureSource(ScrollEngine& engine);
+    
+    bool handleEvent(const InputEvent& event) override;
+    enum libinput_device_capability capability() const override { return LIBINPUT_DEVICE_CAP_TOUCH; }
     
     /**
-     * Инициализация libinput и scroll emulator
+     * Параметры движения сенсорного экрана
      */
-    bool initialize();
+    static const MotionProfile PROFILE;
+
+private:
+    ScrollEngine& engine_;
+    TouchScrollState touch_state_;
     
     /**
-     * Очистка ресурсов
+     * Обработка нажатия пальца на экран
      */
-    void cleanup();
+    void handleTouchDown(const InputEvent& event);
     
     /**
-     * Основной цикл обработки событий
+     * Обработка движения пальца по экрану (только обновляет позицию слота)
      */
-    void run();
+    void handleTouchMotion(const InputEvent& event);
     
     /**
-     * Остановка обработки
+     * Конец аппаратного кадра: одно решение о скролле по центру всех пальцев
      */
-    void stop();
+    void handleTouchFrame();
     
     /**
-     * Настройки прокрутки
+     * Обработка отрыва пальца от экрана или отмены касания системой
      */
-    void setScrollConfig(const ScrollEmulator::ScrollConfig& config);
+    void handleTouchUp(const InputEvent& event);
     
     /**
-     * Включить/отключить подробный вывод
+     * Касание относится к назначенному жесту: до активации - по текущему
+     * числу пальцев, после - пока пальцев столько же, сколько при активации
      */
-    void setVerbose(bool verbose) { verbose_ = verbose; }
+    bool isBoundTouch() const;
+};
 
-private:
-    struct libinput* li_;
-    struct udev* udev_;
-    int fd_;
-    bool running_;
-    bool verbose_;
+/**
+ * Обработчик touch событий для плавной прокрутки на сенсорных экранах:
+ * ScrollEngine с источником TouchGestureSource
+ */
+class TouchScrollHandler {
+public:
+    TouchScrollHandler();
+    ~TouchScrollHandler();
     
-    std::unique_ptr<ScrollEmulator> scroll_emulator_;
-    TouchScrollState touch_state_;
+    /**
+     * Инициализация libinput и scroll emulator
+     */
+    bool initialize();
     
     /**
-     * Обработка событий libinput
+     * Очистка ресурсов
      */
-    void processEvents();
+    void cleanup();
     
     /**
-     * Обработка нажатия пальца на экран
+     * Основной цикл обработки событий
      */
-    void handleTouchDown(struct libinput_event_touch* touch);
+    void run();
     
     /**
-     * Обработка движения пальца по экрану
+     * Остановка обработки
      */
-    void handleTouchMotion(struct libinput_event_touch* touch);
+    void stop();
     
     /**
-     * Обработка отрыва пальца от экрана
+     * Настройки прокрутки
      */
-    void handleTouchUp(struct libinput_event_touch* touch);
+    void setScrollConfig(const ScrollEmulator::ScrollConfig& config);
+    
+    /**
+     * Включить/отключить подробный вывод
+     */
+    void setVerbose(bool verbose) { verbose_ = verbose; engine_.setVerbose(verbose); }
     
     /**
-     * Определение направления жеста
+     * Назначения жестов (число пальцев -> действие)
      */
-    TouchDirection calculateDirection(double delta_x, double delta_y);
+    void setBindings(const GestureBindings& bindings) { engine_.setBindings(bindings); }
     
     /**
-     * Выполнение плавной прокрутки на основе дельты движения
+     * Управляющий unix сокет (команды stop, cancel, status)
      */
-    void performSmoothScroll(double delta_x, double delta_y);
+    void setControlSocket(const std::string& path) { engine_.setControlSocket(path); }
     
     /**
-     * Проверка, прошло ли достаточно времени для следующего скролла
+     * Отдельный поток ввода (приоритет реального времени, привязка к CPU)
      */
-    bool shouldScroll();
+    void setInputThread(const ScrollEngine::InputThreadConfig& config) { engine_.setInputThread(config); }
     
     /**
-     * Вычисление интенсивности скролла на основе скорости жеста
+     * Разрешенные устройства (имя, eventN или vid:pid)
      */
-    int calculateScrollIntensity(double delta, double time_diff_ms);
+    void setDeviceFilters(const std::vector<ScrollEngine::DeviceFilter>& filters) { engine_.setDeviceFilters(filters); }
     
     /**
-     * Открытие libinput устройства
+     * Seat для udev (по умолчанию seat0)
      */
-    static int openRestricted(const char* path, int flags, void* user_data);
+    void setSeat(const std::string& seat) { engine_.setSeat(seat); }
     
     /**
-     * Закрытие libinput устройства
+     * Явные пути /dev/input/eventN вместо перечисления устройств через udev
      */
-    static void closeRestricted(int fd, void* user_data);
+    void setDevicePaths(const std::vector<std::string>& paths) { engine_.setDevicePaths(paths); }
+
+private:
+    ScrollEngine engine_;
+    bool verbose_;
 };
 
 #endif // TOUCH_SCROLL_HANDLER_H 
\ No newline at end of file